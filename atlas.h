@@ -0,0 +1,223 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#include "gl_state.h"
+#include "texture.h"
+#include "texture_array.h"
+
+/**
+ * Online texture atlas.
+ *
+ * Small images are packed into the layers ("pages") of one RGBA8 GL_TEXTURE_2D_ARRAY with MaxRects (best short side
+ * fit), so thousands of them can be drawn with a single texture binding. Regions can be removed again: their
+ * space goes straight back to the free list, and a page remembers its live regions and rebuilds the free list from
+ * them when an insert does not fit otherwise, so freed space merges with the free space around it however the
+ * regions come and go. Every region gets a gutter of padding texels filled with its edge texels so linear filtering
+ * never bleeds into the neighbours.
+ * */
+
+struct AtlasRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+struct AtlasRegion {
+    int page = -1;
+    AtlasRect rect;      // including padding
+    float u0 = 0, v0 = 0; // texel area of the image only
+    float u1 = 0, v1 = 0;
+};
+
+struct AtlasPage {
+    std::vector<AtlasRect> free;
+    std::vector<AtlasRect> used;
+    bool stale = false; // free does not include removed regions yet
+};
+
+class TextureAtlas {
+public:
+    // storage for all max_pages layers is allocated up front
+    explicit TextureAtlas(int page_size = 1024, int max_pages = 4, int padding = 1)
+            : page_size(page_size), max_pages(max_pages), padding(padding) {
+        glGenTextures(1, &array);
+        gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, array);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, page_size, page_size, max_pages, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    TextureAtlas(const TextureAtlas &) = delete;
+
+    TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+    ~TextureAtlas() {
+        release();
+    }
+
+    // free the GL texture while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        if (array) {
+            glDeleteTextures(1, &array);
+            gl_state.forget_texture(array);
+        }
+        array = 0;
+    }
+
+    // pack image and upload it into its page, returns false if it does not fit into any page
+    bool insert(const Image &image, AtlasRegion &region) {
+        int width = image.width + 2 * padding, height = image.height + 2 * padding;
+        if (width > page_size || height > page_size) return false;
+
+        int page = 0;
+        AtlasRect rect;
+        for (; page < (int) pages.size(); page++) {
+            AtlasPage &candidate = pages[page];
+            // freed space only merges with its neighbours in a rebuild, do one when it could make room
+            // or when the unmerged pieces make the free list long
+            if (candidate.stale && candidate.free.size() > 2 * candidate.used.size() + 64) rebuild(candidate);
+            if (find_position(candidate, width, height, rect)) break;
+            if (candidate.stale) {
+                rebuild(candidate);
+                if (find_position(candidate, width, height, rect)) break;
+            }
+        }
+        if (page == (int) pages.size()) {
+            if (page == max_pages) return false;
+            AtlasPage fresh;
+            fresh.free = {{0, 0, page_size, page_size}};
+            pages.push_back(fresh);
+            find_position(pages[page], width, height, rect);
+        }
+        place(pages[page], rect);
+        pages[page].used.push_back(rect);
+
+        region.page = page;
+        region.rect = rect;
+        region.u0 = (float) (rect.x + padding) / (float) page_size;
+        region.v0 = (float) (rect.y + padding) / (float) page_size;
+        region.u1 = (float) (rect.x + padding + image.width) / (float) page_size;
+        region.v1 = (float) (rect.y + padding + image.height) / (float) page_size;
+        upload(page, rect, image);
+        return true;
+    }
+
+    // give the space of region back, its texels are left as they are
+    void remove(const AtlasRegion &region) {
+        AtlasPage &page = pages[region.page];
+        for (size_t i = 0; i < page.used.size(); i++) {
+            const AtlasRect &rect = page.used[i];
+            if (rect.x == region.rect.x && rect.y == region.rect.y) {
+                page.used[i] = page.used.back();
+                page.used.pop_back();
+                break;
+            }
+        }
+        // usable right away as it is, merged with the free space around it by the next rebuild
+        if (page.used.empty()) {
+            page.free = {{0, 0, page_size, page_size}};
+            page.stale = false;
+            return;
+        }
+        page.free.push_back(region.rect);
+        page.stale = true;
+    }
+
+    // the GL_TEXTURE_2D_ARRAY holding all pages, AtlasRegion::page is the layer
+    GLuint texture() const {
+        return array;
+    }
+
+    int page_count() const {
+        return (int) pages.size();
+    }
+
+private:
+    int page_size;
+    int max_pages;
+    int padding;
+    GLuint array = 0;
+    std::vector<AtlasPage> pages;
+
+    // best short side fit over all free rectangles
+    static bool find_position(const AtlasPage &page, int width, int height, AtlasRect &rect) {
+        int best_short = INT_MAX, best_long = INT_MAX;
+        for (const AtlasRect &free: page.free) {
+            if (free.width < width || free.height < height) continue;
+            int dx = free.width - width, dy = free.height - height;
+            int short_side = std::min(dx, dy), long_side = std::max(dx, dy);
+            if (short_side < best_short || (short_side == best_short && long_side < best_long)) {
+                best_short = short_side;
+                best_long = long_side;
+                rect = {free.x, free.y, width, height};
+            }
+        }
+        return best_short != INT_MAX;
+    }
+
+    // the maximal free rectangles around the live regions, splitting does not depend on the order
+    void rebuild(AtlasPage &page) const {
+        page.free = {{0, 0, page_size, page_size}};
+        for (const AtlasRect &rect: page.used) place(page, rect);
+        page.stale = false;
+    }
+
+    // split every free rectangle overlapping rect into the up to 4 maximal rectangles around it
+    static void place(AtlasPage &page, const AtlasRect &rect) {
+        std::vector<AtlasRect> next, split;
+        for (const AtlasRect &free: page.free) {
+            if (rect.x >= free.x + free.width || rect.x + rect.width <= free.x ||
+                rect.y >= free.y + free.height || rect.y + rect.height <= free.y) {
+                next.push_back(free);
+                continue;
+            }
+            if (rect.x > free.x)
+                split.push_back({free.x, free.y, rect.x - free.x, free.height});
+            if (rect.x + rect.width < free.x + free.width)
+                split.push_back({rect.x + rect.width, free.y, free.x + free.width - rect.x - rect.width, free.height});
+            if (rect.y > free.y)
+                split.push_back({free.x, free.y, free.width, rect.y - free.y});
+            if (rect.y + rect.height < free.y + free.height)
+                split.push_back({free.x, rect.y + rect.height, free.width, free.y + free.height - rect.y - rect.height});
+        }
+        // the untouched rectangles were maximal before and still are, only the pieces can be inside another one
+        for (size_t i = 0; i < split.size(); i++) {
+            bool inside = false;
+            for (size_t j = 0; j < next.size() && !inside; j++) inside = contains(next[j], split[i]);
+            for (size_t j = i + 1; j < split.size() && !inside; j++) inside = contains(split[j], split[i]);
+            if (!inside) next.push_back(split[i]);
+        }
+        page.free = std::move(next);
+    }
+
+    static bool contains(const AtlasRect &a, const AtlasRect &b) {
+        return b.x >= a.x && b.y >= a.y && b.x + b.width <= a.x + a.width && b.y + b.height <= a.y + a.height;
+    }
+
+    // expand to RGBA with the edge texels extruded into the gutter
+    void upload(int page, const AtlasRect &rect, const Image &image) const {
+        std::vector<unsigned char> texels = expand_to_rgba(image);
+        std::vector<unsigned char> rgba((size_t) rect.width * rect.height * 4);
+        for (int y = 0; y < rect.height; y++) {
+            int sy = std::clamp(y - padding, 0, image.height - 1);
+            for (int x = 0; x < rect.width; x++) {
+                int sx = std::clamp(x - padding, 0, image.width - 1);
+                std::memcpy(&rgba[((size_t) y * rect.width + x) * 4], &texels[((size_t) sy * image.width + sx) * 4], 4);
+            }
+        }
+        gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, array);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, rect.x, rect.y, page, rect.width, rect.height, 1, GL_RGBA,
+                        GL_UNSIGNED_BYTE, rgba.data());
+    }
+};
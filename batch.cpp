@@ -0,0 +1,147 @@
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+#include "atlas.h"
+#include "quad_batch.h"
+#include "shader_manager.h"
+
+/**
+ * 100k textured quads per frame from a texture atlas with a single instanced draw call.
+ * */
+
+int main() {
+    std::cout << "Current working directory: " << std::filesystem::current_path() << std::endl;
+
+    // glfw: initialize and configure
+    // ------------------------------
+    if (!glfwInit()) {
+        fprintf(stderr, "ERROR: could not start GLFW3\n");
+        return 1;
+    }
+
+    // glfw window creation
+    // --------------------
+    GLFWwindow *window = glfwCreateWindow(1000, 1000, "OpenGLPlayground", nullptr, nullptr);
+    if (!window) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    // measure the batcher, not the display
+    glfwSwapInterval(0);
+
+    // start GLEW extension handler
+    glewExperimental = GL_TRUE;
+    glewInit();
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // the batch programs are loaded from ../shaders and hot-reloaded on change
+    ShaderManager shaders;
+    QuadBatch batch(shaders);
+    if (!batch.valid()) {
+        glfwTerminate();
+        return 114;
+    }
+    shaders.watch("../shaders");
+
+    // icons: the two jpgs plus a few hundred generated discs of different sizes
+    TextureAtlas atlas(1024, 4);
+    std::vector<AtlasRegion> icons;
+    for (const char *path: {"../256.jpg", "../256g.jpg"}) {
+        Image image = load_image(path);
+        AtlasRegion region;
+        if (image.data && atlas.insert(image, region)) icons.push_back(region);
+        stbi_image_free(image.data);
+    }
+    std::mt19937 rng(42);
+    for (int i = 0; i < 500; i++) {
+        int size = 8 + (int) (rng() % 40);
+        std::vector<unsigned char> pixels((size_t) size * size * 4);
+        unsigned char r = rng() % 256, g = rng() % 256, b = rng() % 256;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                float dx = (float) x - (float) size / 2 + 0.5f, dy = (float) y - (float) size / 2 + 0.5f;
+                bool inside = dx * dx + dy * dy <= (float) size * (float) size / 4;
+                unsigned char *p = &pixels[((size_t) y * size + x) * 4];
+                p[0] = r;
+                p[1] = g;
+                p[2] = b;
+                p[3] = inside ? 255 : 0;
+            }
+        }
+        AtlasRegion region;
+        if (atlas.insert({pixels.data(), size, size, 4}, region)) icons.push_back(region);
+    }
+    printf("%zu icons in %d atlas pages\n", icons.size(), atlas.page_count());
+
+    // quads drift around their start position
+    const int count = 100000;
+    struct Sprite {
+        float x, y, size, speed;
+        int icon;
+        uint32_t tint;
+    };
+    std::vector<Sprite> sprites(count);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (auto &sprite: sprites) {
+        sprite = {unit(rng), unit(rng), 0.005f + 0.02f * std::abs(unit(rng)), unit(rng),
+                  (int) (rng() % icons.size()), (uint32_t) rng() | 0xffu};
+    }
+
+    // render loop
+    // -----------
+    double lastTime = glfwGetTime();
+    int nbFrames = 0;
+    double cpuTime = 0;
+    while (!glfwWindowShouldClose(window)) {
+        double currentTime = glfwGetTime();
+        nbFrames++;
+        if (currentTime - lastTime >= 1.0) {
+            printf("%f fps, %d quads, %f ms cpu per frame\n", double(nbFrames), count, cpuTime * 1000 / nbFrames);
+            nbFrames = 0;
+            cpuTime = 0;
+            lastTime += 1.0;
+        }
+
+        shaders.update();
+        auto start = std::chrono::steady_clock::now();
+        batch.clear();
+        for (const auto &sprite: sprites) {
+            float x = sprite.x + 0.05f * std::sin((float) currentTime * sprite.speed);
+            float y = sprite.y + 0.05f * std::cos((float) currentTime * sprite.speed);
+            batch.add(x, y, x + sprite.size, y + sprite.size, icons[sprite.icon], sprite.tint);
+        }
+        glClear(GL_COLOR_BUFFER_BIT);
+        batch.draw(atlas.texture());
+        cpuTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+        // -------------------------------------------------------------------------------
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    // optional: de-allocate all resources once they've outlived their purpose:
+    // ------------------------------------------------------------------------
+    batch.release();
+    shaders.release();
+    atlas.release();
+
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,611 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BC_SSE 1
+#endif
+
+#include "parallel.h"
+#include "texture.h"
+
+/**
+ * Runtime block compression of decoded images.
+ *
+ * 1 channel -> BC4, 2 channels -> BC5, 3 channels -> BC1, 4 channels -> BC3, or BC7 for 3 and 4 channels when
+ * asked for (mode 6 only: one subset, 7 bit RGBA endpoints with p-bits, 4 bit indices, so no partition search).
+ * Blocks are 4x4 texels, partial blocks at the right/bottom edge repeat the last texel.
+ * Palette fitting, where the encoder spends its time, compares 4 texels at once with SSE when available,
+ * and block rows are spread over all hardware threads.
+ * */
+
+enum class BcQuality {
+    Fast, // bounding box endpoints
+    High, // principal axis endpoints + least squares refinement, tries both BC4 modes
+};
+
+struct CompressedImage {
+    GLenum format = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<unsigned char> data;
+};
+
+inline GLenum bc_format(int channels, bool bc7 = false) {
+    if (bc7 && channels >= 3) return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    switch (channels) {
+        case 1:
+            return GL_COMPRESSED_RED_RGTC1;
+        case 2:
+            return GL_COMPRESSED_RG_RGTC2;
+        case 3:
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        default:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+}
+
+inline int bc_block_bytes(GLenum format) {
+    return format == GL_COMPRESSED_RED_RGTC1 || format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+inline size_t bc_level_bytes(GLenum format, int width, int height) {
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * bc_block_bytes(format);
+}
+
+inline bool bc_supported() {
+    return GLEW_EXT_texture_compression_s3tc && GLEW_ARB_texture_compression_rgtc;
+}
+
+inline bool bc7_supported() {
+    return GLEW_ARB_texture_compression_bptc;
+}
+
+// 565 helpers
+inline uint16_t bc_pack_565(const float *c) {
+    int r = std::clamp((int) (c[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+    int g = std::clamp((int) (c[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+    int b = std::clamp((int) (c[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+    return (uint16_t) (r << 11 | g << 5 | b);
+}
+
+inline void bc_unpack_565(uint16_t v, float *c) {
+    int r = v >> 11 & 31, g = v >> 5 & 63, b = v & 31;
+    c[0] = (float) (r << 3 | r >> 2);
+    c[1] = (float) (g << 2 | g >> 4);
+    c[2] = (float) (b << 3 | b >> 2);
+}
+
+// picks the nearest of the 4 palette entries for every texel, returns the squared error
+inline float bc1_fit_indices(const float rgb[16][3], uint16_t c0, uint16_t c1, uint32_t &indices) {
+    float palette[4][3];
+    bc_unpack_565(c0, palette[0]);
+    bc_unpack_565(c1, palette[1]);
+    for (int k = 0; k < 3; k++) {
+        palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+        palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+    }
+    float error = 0;
+    indices = 0;
+#ifdef BC_SSE
+    for (int i = 0; i < 16; i += 4) {
+        __m128 r = _mm_setr_ps(rgb[i][0], rgb[i + 1][0], rgb[i + 2][0], rgb[i + 3][0]);
+        __m128 g = _mm_setr_ps(rgb[i][1], rgb[i + 1][1], rgb[i + 2][1], rgb[i + 3][1]);
+        __m128 b = _mm_setr_ps(rgb[i][2], rgb[i + 1][2], rgb[i + 2][2], rgb[i + 3][2]);
+        __m128 best = _mm_set1_ps(1e30f), best_index = _mm_setzero_ps();
+        for (int p = 0; p < 4; p++) {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128 closer = _mm_cmplt_ps(d, best);
+            best = _mm_min_ps(d, best);
+            best_index = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float) p)), _mm_andnot_ps(closer, best_index));
+        }
+        float distances[4], chosen[4];
+        _mm_storeu_ps(distances, best);
+        _mm_storeu_ps(chosen, best_index);
+        for (int j = 0; j < 4; j++) {
+            indices |= (uint32_t) chosen[j] << (2 * (i + j));
+            error += distances[j];
+        }
+    }
+#else
+    for (int i = 0; i < 16; i++) {
+        float best = 1e30f;
+        uint32_t best_index = 0;
+        for (uint32_t p = 0; p < 4; p++) {
+            float dr = rgb[i][0] - palette[p][0], dg = rgb[i][1] - palette[p][1], db = rgb[i][2] - palette[p][2];
+            float d = dr * dr + dg * dg + db * db;
+            if (d < best) {
+                best = d;
+                best_index = p;
+            }
+        }
+        indices |= best_index << (2 * i);
+        error += best;
+    }
+#endif
+    return error;
+}
+
+// quantize endpoints, force 4 colour mode (c0 > c1) and fit indices
+inline float bc1_encode_endpoints(const float rgb[16][3], const float *a, const float *b, unsigned char *out) {
+    uint16_t c0 = bc_pack_565(a), c1 = bc_pack_565(b);
+    if (c0 < c1) std::swap(c0, c1);
+    uint32_t indices = 0;
+    float error = c0 == c1 ? bc1_fit_indices(rgb, c0, c0, indices) : bc1_fit_indices(rgb, c0, c1, indices);
+    if (c0 == c1) indices = 0;
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &indices, 4);
+    return error;
+}
+
+inline void bc1_encode_block(const float rgb[16][3], unsigned char *out, BcQuality quality) {
+    float lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int k = 0; k < 3; k++) {
+            lo[k] = std::min(lo[k], rgb[i][k]);
+            hi[k] = std::max(hi[k], rgb[i][k]);
+        }
+    }
+
+    if (quality == BcQuality::Fast) {
+        // inset the bounding box a little, the extremes are rarely hit exactly by the palette
+        for (int k = 0; k < 3; k++) {
+            float inset = (hi[k] - lo[k]) / 16;
+            lo[k] += inset;
+            hi[k] -= inset;
+        }
+        bc1_encode_endpoints(rgb, hi, lo, out);
+        return;
+    }
+
+    // principal axis of the block colours by power iteration on the covariance matrix
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) for (int k = 0; k < 3; k++) mean[k] += rgb[i][k] / 16;
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        float r = rgb[i][0] - mean[0], g = rgb[i][1] - mean[1], b = rgb[i][2] - mean[2];
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+    float axis[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float m = std::max({std::abs(x), std::abs(y), std::abs(z)});
+        if (m == 0) break;
+        axis[0] = x / m;
+        axis[1] = y / m;
+        axis[2] = z / m;
+    }
+
+    float min_t = 1e30f, max_t = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = (rgb[i][0] - mean[0]) * axis[0] + (rgb[i][1] - mean[1]) * axis[1] + (rgb[i][2] - mean[2]) * axis[2];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+    float length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float a[3], b[3];
+    for (int k = 0; k < 3; k++) {
+        float scale = length > 0 ? axis[k] / length : 0;
+        a[k] = std::clamp(mean[k] + max_t * scale, 0.0f, 255.0f);
+        b[k] = std::clamp(mean[k] + min_t * scale, 0.0f, 255.0f);
+    }
+    float error = bc1_encode_endpoints(rgb, a, b, out);
+
+    // one least squares refinement of the endpoints for the chosen indices
+    uint16_t c0, c1;
+    uint32_t indices;
+    std::memcpy(&c0, out, 2);
+    std::memcpy(&c1, out + 2, 2);
+    std::memcpy(&indices, out + 4, 4);
+    if (c0 == c1) return;
+    static const float weight[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0, ab = 0, bb = 0, ap[3] = {0, 0, 0}, bp[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        float wa = weight[indices >> (2 * i) & 3], wb = 1 - wa;
+        aa += wa * wa;
+        ab += wa * wb;
+        bb += wb * wb;
+        for (int k = 0; k < 3; k++) {
+            ap[k] += wa * rgb[i][k];
+            bp[k] += wb * rgb[i][k];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-6f) return;
+    for (int k = 0; k < 3; k++) {
+        a[k] = std::clamp((ap[k] * bb - bp[k] * ab) / det, 0.0f, 255.0f);
+        b[k] = std::clamp((bp[k] * aa - ap[k] * ab) / det, 0.0f, 255.0f);
+    }
+    unsigned char refined[8];
+    if (bc1_encode_endpoints(rgb, a, b, refined) < error) std::memcpy(out, refined, 8);
+}
+
+// single channel block, mode with 8 interpolated values (r0 > r1) or 6 values + 0/255 (r0 <= r1)
+inline float bc4_encode_mode(const float v[16], int r0, int r1, unsigned char *out) {
+    float palette[8];
+    palette[0] = (float) r0;
+    palette[1] = (float) r1;
+    if (r0 > r1) {
+        for (int i = 2; i < 8; i++) palette[i] = (float) ((8 - i) * r0 + (i - 1) * r1) / 7;
+    } else {
+        for (int i = 2; i < 6; i++) palette[i] = (float) ((6 - i) * r0 + (i - 1) * r1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t indices = 0;
+    float error = 0;
+    for (int i = 0; i < 16; i++) {
+        float best = 1e30f;
+        uint64_t best_index = 0;
+        for (uint64_t p = 0; p < 8; p++) {
+            float d = (v[i] - palette[p]) * (v[i] - palette[p]);
+            if (d < best) {
+                best = d;
+                best_index = p;
+            }
+        }
+        indices |= best_index << (3 * i);
+        error += best;
+    }
+    out[0] = (unsigned char) r0;
+    out[1] = (unsigned char) r1;
+    for (int i = 0; i < 6; i++) out[2 + i] = (unsigned char) (indices >> (8 * i));
+    return error;
+}
+
+inline void bc4_encode_block(const float v[16], unsigned char *out, BcQuality quality) {
+    float lo = 255, hi = 0, lo_inner = 255, hi_inner = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = std::min(lo, v[i]);
+        hi = std::max(hi, v[i]);
+        if (v[i] > 0) lo_inner = std::min(lo_inner, v[i]);
+        if (v[i] < 255) hi_inner = std::max(hi_inner, v[i]);
+    }
+    int r0 = (int) (hi + 0.5f), r1 = (int) (lo + 0.5f);
+    if (r0 == r1) {
+        // flat block, every index 0
+        out[0] = out[1] = (unsigned char) r0;
+        std::memset(out + 2, 0, 6);
+        return;
+    }
+    float error = bc4_encode_mode(v, r0, r1, out);
+    if (quality == BcQuality::Fast || lo_inner > hi_inner) return;
+
+    // blocks with hard 0/255 texels often do better with the explicit 0 and 255 entries
+    unsigned char alternative[8];
+    if (bc4_encode_mode(v, (int) (lo_inner + 0.5f), (int) (hi_inner + 0.5f), alternative) < error)
+        std::memcpy(out, alternative, 8);
+}
+
+// BC7 mode 6 interpolation weights of the 4 bit indices, out of 64
+inline constexpr int bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// nearest of the 16 palette entries between the 8 bit endpoints e0 and e1 for every texel, returns the squared error
+inline float bc7_fit_indices(const float texels[16][4], const int e0[4], const int e1[4], uint8_t indices[16]) {
+    float palette[16][4];
+    for (int p = 0; p < 16; p++) {
+        for (int k = 0; k < 4; k++)
+            palette[p][k] = (float) (((64 - bc7_weights[p]) * e0[k] + bc7_weights[p] * e1[k] + 32) >> 6);
+    }
+    float error = 0;
+#ifdef BC_SSE
+    for (int i = 0; i < 16; i += 4) {
+        __m128 channel[4];
+        for (int k = 0; k < 4; k++)
+            channel[k] = _mm_setr_ps(texels[i][k], texels[i + 1][k], texels[i + 2][k], texels[i + 3][k]);
+        __m128 best = _mm_set1_ps(1e30f), best_index = _mm_setzero_ps();
+        for (int p = 0; p < 16; p++) {
+            __m128 d = _mm_setzero_ps();
+            for (int k = 0; k < 4; k++) {
+                __m128 delta = _mm_sub_ps(channel[k], _mm_set1_ps(palette[p][k]));
+                d = _mm_add_ps(d, _mm_mul_ps(delta, delta));
+            }
+            __m128 closer = _mm_cmplt_ps(d, best);
+            best = _mm_min_ps(d, best);
+            best_index = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float) p)), _mm_andnot_ps(closer, best_index));
+        }
+        float distances[4], chosen[4];
+        _mm_storeu_ps(distances, best);
+        _mm_storeu_ps(chosen, best_index);
+        for (int j = 0; j < 4; j++) {
+            indices[i + j] = (uint8_t) chosen[j];
+            error += distances[j];
+        }
+    }
+#else
+    for (int i = 0; i < 16; i++) {
+        float best = 1e30f;
+        for (int p = 0; p < 16; p++) {
+            float d = 0;
+            for (int k = 0; k < 4; k++) d += (texels[i][k] - palette[p][k]) * (texels[i][k] - palette[p][k]);
+            if (d < best) {
+                best = d;
+                indices[i] = (uint8_t) p;
+            }
+        }
+        error += best;
+    }
+#endif
+    return error;
+}
+
+// 7 bit endpoint with p-bit p closest to c, q gets the 7 bit values, returns the squared error of the 8 bit result
+inline float bc7_quantize_endpoint(const float c[4], int p, int q[4]) {
+    float error = 0;
+    for (int k = 0; k < 4; k++) {
+        q[k] = std::clamp((int) ((c[k] - (float) p) / 2 + 0.5f), 0, 127);
+        float v = (float) (q[k] << 1 | p);
+        error += (v - c[k]) * (v - c[k]);
+    }
+    return error;
+}
+
+struct Bc7Mode6 {
+    int q0[4], q1[4];
+    int p0, p1;
+    uint8_t indices[16];
+    float error;
+};
+
+// quantize the endpoints a and b and fit the indices; High tries all four p-bit pairs, Fast takes the closest
+// p-bit of each endpoint on its own
+inline Bc7Mode6 bc7_encode_endpoints(const float texels[16][4], const float *a, const float *b, BcQuality quality) {
+    Bc7Mode6 best{};
+    best.error = 1e30f;
+    for (int pair = 0; pair < 4; pair++) {
+        Bc7Mode6 candidate{};
+        candidate.p0 = pair & 1;
+        candidate.p1 = pair >> 1;
+        if (quality == BcQuality::Fast) {
+            int q[4];
+            candidate.p0 = bc7_quantize_endpoint(a, 1, q) < bc7_quantize_endpoint(a, 0, q) ? 1 : 0;
+            candidate.p1 = bc7_quantize_endpoint(b, 1, q) < bc7_quantize_endpoint(b, 0, q) ? 1 : 0;
+        }
+        bc7_quantize_endpoint(a, candidate.p0, candidate.q0);
+        bc7_quantize_endpoint(b, candidate.p1, candidate.q1);
+        int e0[4], e1[4];
+        for (int k = 0; k < 4; k++) {
+            e0[k] = candidate.q0[k] << 1 | candidate.p0;
+            e1[k] = candidate.q1[k] << 1 | candidate.p1;
+        }
+        candidate.error = bc7_fit_indices(texels, e0, e1, candidate.indices);
+        if (candidate.error < best.error) best = candidate;
+        if (quality == BcQuality::Fast) break;
+    }
+    return best;
+}
+
+inline void bc7_write_mode6(Bc7Mode6 block, unsigned char *out) {
+    // the first index is stored with 3 bits, its top bit is implied 0: swap the endpoints if it would be 1
+    if (block.indices[0] & 8) {
+        std::swap(block.q0, block.q1);
+        std::swap(block.p0, block.p1);
+        for (uint8_t &index: block.indices) index = (uint8_t) (15 - index);
+    }
+    uint64_t words[2] = {0, 0};
+    int position = 0;
+    auto put = [&](uint64_t value, int bits) {
+        for (int bit = 0; bit < bits; bit++, position++)
+            words[position / 64] |= (value >> bit & 1) << (position % 64);
+    };
+    put(1 << 6, 7); // mode 6
+    for (int k = 0; k < 4; k++) {
+        put((uint64_t) block.q0[k], 7);
+        put((uint64_t) block.q1[k], 7);
+    }
+    put((uint64_t) block.p0, 1);
+    put((uint64_t) block.p1, 1);
+    put(block.indices[0], 3);
+    for (int i = 1; i < 16; i++) put(block.indices[i], 4);
+    std::memcpy(out, words, 16);
+}
+
+inline void bc7_encode_block(const float texels[16][4], unsigned char *out, BcQuality quality) {
+    float lo[4] = {255, 255, 255, 255}, hi[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int k = 0; k < 4; k++) {
+            lo[k] = std::min(lo[k], texels[i][k]);
+            hi[k] = std::max(hi[k], texels[i][k]);
+        }
+    }
+
+    if (quality == BcQuality::Fast) {
+        for (int k = 0; k < 4; k++) {
+            float inset = (hi[k] - lo[k]) / 32;
+            lo[k] += inset;
+            hi[k] -= inset;
+        }
+        bc7_write_mode6(bc7_encode_endpoints(texels, lo, hi, quality), out);
+        return;
+    }
+
+    // principal axis in RGBA, as for BC1
+    float mean[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; i++) for (int k = 0; k < 4; k++) mean[k] += texels[i][k] / 16;
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 4; k++) cov[j][k] += (texels[i][j] - mean[j]) * (texels[i][k] - mean[k]);
+        }
+    }
+    float axis[4] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], hi[3] - lo[3]};
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {0, 0, 0, 0}, m = 0;
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 4; k++) next[j] += cov[j][k] * axis[k];
+            m = std::max(m, std::abs(next[j]));
+        }
+        if (m == 0) break;
+        for (int k = 0; k < 4; k++) axis[k] = next[k] / m;
+    }
+    float min_t = 1e30f, max_t = -1e30f, length = 0;
+    for (int i = 0; i < 16; i++) {
+        float t = 0;
+        for (int k = 0; k < 4; k++) t += (texels[i][k] - mean[k]) * axis[k];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+    for (float v: axis) length += v * v;
+    float a[4], b[4];
+    for (int k = 0; k < 4; k++) {
+        float scale = length > 0 ? axis[k] / length : 0;
+        a[k] = std::clamp(mean[k] + min_t * scale, 0.0f, 255.0f);
+        b[k] = std::clamp(mean[k] + max_t * scale, 0.0f, 255.0f);
+    }
+    Bc7Mode6 block = bc7_encode_endpoints(texels, a, b, quality);
+
+    // one least squares refinement of the endpoints for the chosen indices
+    float aa = 0, ab = 0, bb = 0, ap[4] = {0, 0, 0, 0}, bp[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        float wb = (float) bc7_weights[block.indices[i]] / 64, wa = 1 - wb;
+        aa += wa * wa;
+        ab += wa * wb;
+        bb += wb * wb;
+        for (int k = 0; k < 4; k++) {
+            ap[k] += wa * texels[i][k];
+            bp[k] += wb * texels[i][k];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::abs(det) >= 1e-6f) {
+        for (int k = 0; k < 4; k++) {
+            a[k] = std::clamp((ap[k] * bb - bp[k] * ab) / det, 0.0f, 255.0f);
+            b[k] = std::clamp((bp[k] * aa - ap[k] * ab) / det, 0.0f, 255.0f);
+        }
+        Bc7Mode6 refined = bc7_encode_endpoints(texels, a, b, quality);
+        if (refined.error < block.error) block = refined;
+    }
+    bc7_write_mode6(block, out);
+}
+
+inline CompressedImage compress_image(const Image &image, BcQuality quality = BcQuality::Fast, bool bc7 = false) {
+    CompressedImage result;
+    result.width = image.width;
+    result.height = image.height;
+    result.channels = image.channels;
+    result.format = bc_format(image.channels, bc7);
+    int blocks_x = (image.width + 3) / 4, blocks_y = (image.height + 3) / 4;
+    int block_bytes = bc_block_bytes(result.format);
+    result.data.resize(bc_level_bytes(result.format, image.width, image.height));
+
+    parallel_for(0, blocks_y, [&](int begin, int end) {
+        float texels[16][4];
+        float channel[16];
+        float rgb[16][3];
+        for (int by = begin; by < end; by++) {
+            for (int bx = 0; bx < blocks_x; bx++) {
+                for (int i = 0; i < 16; i++) {
+                    int x = std::min(bx * 4 + i % 4, image.width - 1);
+                    int y = std::min(by * 4 + i / 4, image.height - 1);
+                    const unsigned char *p = image.data + ((size_t) y * image.width + x) * image.channels;
+                    for (int k = 0; k < 4; k++) texels[i][k] = k < image.channels ? p[k] : 255.0f;
+                }
+                unsigned char *out = result.data.data() + ((size_t) by * blocks_x + bx) * block_bytes;
+                if (result.format == GL_COMPRESSED_RGBA_BPTC_UNORM) {
+                    bc7_encode_block(texels, out, quality);
+                    continue;
+                }
+                switch (image.channels) {
+                    case 1:
+                    case 2:
+                        for (int k = 0; k < image.channels; k++) {
+                            for (int i = 0; i < 16; i++) channel[i] = texels[i][k];
+                            bc4_encode_block(channel, out + 8 * k, quality);
+                        }
+                        break;
+                    default:
+                        for (int i = 0; i < 16; i++) for (int k = 0; k < 3; k++) rgb[i][k] = texels[i][k];
+                        if (image.channels == 4) {
+                            for (int i = 0; i < 16; i++) channel[i] = texels[i][3];
+                            bc4_encode_block(channel, out, quality);
+                            out += 8;
+                        }
+                        bc1_encode_block(rgb, out, quality);
+                        break;
+                }
+            }
+        }
+    }, 4);
+    return result;
+}
+
+inline std::string bc_cache_path(const std::string &source, BcQuality quality, bool bc7) {
+    return source + (quality == BcQuality::High ? ".hq" : "") + (bc7 ? ".bc7" : ".bc");
+}
+
+// on-disk cache of a whole mip chain: a tiny header followed by the raw blocks of every level, stale when older
+// than the source image
+inline bool load_compressed_cache(const std::string &path, const std::string &source,
+                                  std::vector<CompressedImage> &levels) {
+    std::error_code ec;
+    auto cache_time = std::filesystem::last_write_time(path, ec);
+    if (ec || cache_time < std::filesystem::last_write_time(source, ec) || ec) return false;
+
+    std::ifstream in(path, std::ios::binary);
+    char magic[4];
+    uint32_t header[5];
+    if (!in.read(magic, 4) || std::memcmp(magic, "BCC2", 4) != 0) return false;
+    if (!in.read((char *) header, sizeof(header)) || header[4] == 0 || header[4] > 32) return false;
+    levels.assign(header[4], {});
+    int width = (int) header[1], height = (int) header[2];
+    for (CompressedImage &level: levels) {
+        level.format = header[0];
+        level.width = width;
+        level.height = height;
+        level.channels = (int) header[3];
+        level.data.resize(bc_level_bytes(level.format, width, height));
+        if (!in.read((char *) level.data.data(), (std::streamsize) level.data.size())) return false;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return true;
+}
+
+// levels has to be a chain, each level half the size of the one before
+inline void save_compressed_cache(const std::string &path, const std::vector<CompressedImage> &levels) {
+    if (levels.empty()) return;
+    const CompressedImage &base = levels[0];
+    std::ofstream out(path, std::ios::binary);
+    uint32_t header[5] = {base.format, (uint32_t) base.width, (uint32_t) base.height, (uint32_t) base.channels,
+                          (uint32_t) levels.size()};
+    out.write("BCC2", 4);
+    out.write((const char *) header, sizeof(header));
+    for (const CompressedImage &level: levels)
+        out.write((const char *) level.data.data(), (std::streamsize) level.data.size());
+}
+
+// (re)specify a level of texture with the compressed blocks
+inline void upload_compressed(GLuint texture, const CompressedImage &image, int level = 0) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, image.width, image.height, 0,
+                           (GLsizei) image.data.size(), image.data.data());
+    set_texture_swizzle(image.channels);
+}
+
+// write the blocks into a level of layer of the compressed GL_TEXTURE_2D_ARRAY bound to the active unit, image has
+// to be in the array's format. Binds nothing itself, like upload_array_layer
+inline void upload_compressed_layer(int layer, const CompressedImage &image, int level = 0) {
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, image.width, image.height, 1, image.format,
+                              (GLsizei) image.data.size(), image.data.data());
+}
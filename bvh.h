@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "vecmath.h"
+
+/**
+ * Frustum culling over a 4-wide bounding volume hierarchy.
+ *
+ * Every node stores its four children's AABBs as structure of arrays, so one node test checks all four children
+ * against a frustum plane with a single SSE operation per axis (scalar fallback without SSE). Subtrees entirely
+ * outside are skipped, subtrees entirely inside are reported without further plane tests, so off-screen objects
+ * cost a share of one node test each.
+ *
+ * Objects are added once and their bounds updated as they move. cull() rebuilds the tree when objects were added
+ * and otherwise refits it bottom-up; a refit that has loosened the tree too far (total node surface area grown by
+ * half since the build) triggers a rebuild instead.
+ * */
+
+struct Aabb {
+    vec3 min, max;
+};
+
+inline Aabb merge(const Aabb &a, const Aabb &b) {
+    return {{std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)},
+            {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)}};
+}
+
+inline float surface_area(const Aabb &box) {
+    vec3 d = box.max - box.min;
+    return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// bounds of a transformed box (Arvo), exact for rotations, translations and scales
+inline Aabb transform_aabb(const mat4 &m, const Aabb &box) {
+    float lo[3] = {m.m[12], m.m[13], m.m[14]}, hi[3] = {m.m[12], m.m[13], m.m[14]};
+    const float bmin[3] = {box.min.x, box.min.y, box.min.z}, bmax[3] = {box.max.x, box.max.y, box.max.z};
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 3; column++) {
+            float a = m.m[column * 4 + row] * bmin[column], b = m.m[column * 4 + row] * bmax[column];
+            lo[row] += std::min(a, b);
+            hi[row] += std::max(a, b);
+        }
+    }
+    return {{lo[0], lo[1], lo[2]}, {hi[0], hi[1], hi[2]}};
+}
+
+// the six planes of a view projection matrix (Gribb / Hartmann), a point p is inside when
+// x * p.x + y * p.y + z * p.z + w >= 0 for every plane
+struct Frustum {
+    float x[6], y[6], z[6], w[6];
+};
+
+inline Frustum frustum_from(const mat4 &viewProjection) {
+    const float *m = viewProjection.m;
+    Frustum frustum{};
+    for (int i = 0; i < 6; i++) {
+        int row = i / 2;
+        float sign = i % 2 ? -1.0f : 1.0f;
+        // row 3 +- row 0 (left, right), row 1 (bottom, top), row 2 (near, far)
+        frustum.x[i] = m[3] + sign * m[row];
+        frustum.y[i] = m[7] + sign * m[4 + row];
+        frustum.z[i] = m[11] + sign * m[8 + row];
+        frustum.w[i] = m[15] + sign * m[12 + row];
+    }
+    return frustum;
+}
+
+struct alignas(16) Bvh4Node {
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+    // count > 0: leaf of `count` objects starting at child in the object order
+    // count == 0: inner node, child is its node index; child < 0: empty slot
+    int32_t child[4];
+    uint32_t count[4];
+};
+
+class Bvh {
+public:
+    explicit Bvh(uint32_t leaf_size = 4) : leaf_size(std::max(1u, leaf_size)) {}
+
+    uint32_t add(const Aabb &box) {
+        bounds.push_back(box);
+        built = false;
+        return (uint32_t) bounds.size() - 1;
+    }
+
+    void update(uint32_t id, const Aabb &box) {
+        bounds[id] = box;
+        dirty = true;
+    }
+
+    const Aabb &get(uint32_t id) const {
+        return bounds[id];
+    }
+
+    size_t size() const {
+        return bounds.size();
+    }
+
+    void clear() {
+        bounds.clear();
+        nodes.clear();
+        order.clear();
+        built = false;
+    }
+
+    void build() {
+        nodes.clear();
+        order.resize(bounds.size());
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+        centers.resize(bounds.size());
+        for (size_t i = 0; i < bounds.size(); i++) centers[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+        if (!order.empty()) build_node(0, (uint32_t) order.size());
+        built_area = total_area();
+        built = true;
+        dirty = false;
+    }
+
+    // bottom-up, children always come after their parent in `nodes`
+    void refit() {
+        for (size_t n = nodes.size(); n-- > 0;) {
+            Bvh4Node &node = nodes[n];
+            for (int i = 0; i < 4; i++) {
+                if (node.child[i] < 0) continue;
+                Aabb box = node.count[i] ? range_bounds((uint32_t) node.child[i], node.count[i])
+                                         : node_bounds(nodes[node.child[i]]);
+                set_child_bounds(node, i, box);
+            }
+        }
+        dirty = false;
+        if (total_area() > built_area * 1.5f) build();
+    }
+
+    // calls visible(id) for every object whose bounds intersect the frustum, returns how many there were
+    template<typename F>
+    size_t cull(const Frustum &frustum, F visible) {
+        if (!built) build();
+        else if (dirty) refit();
+        if (nodes.empty()) return 0;
+
+        size_t count = 0;
+        int32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top) {
+            const Bvh4Node &node = nodes[stack[--top]];
+            int outside, inside;
+            test(node, frustum, outside, inside);
+            for (int i = 0; i < 4; i++) {
+                if (node.child[i] < 0 || outside >> i & 1) continue;
+                if (inside >> i & 1) {
+                    count += emit_all(node, i, visible);
+                } else if (node.count[i]) {
+                    // partially inside leaf: test the objects themselves
+                    for (uint32_t j = 0; j < node.count[i]; j++) {
+                        uint32_t id = order[node.child[i] + j];
+                        if (intersects(bounds[id], frustum)) {
+                            visible(id);
+                            count++;
+                        }
+                    }
+                } else {
+                    stack[top++] = node.child[i];
+                }
+            }
+        }
+        return count;
+    }
+
+private:
+    uint32_t leaf_size;
+    std::vector<Aabb> bounds;
+    std::vector<vec3> centers;
+    std::vector<uint32_t> order;
+    std::vector<Bvh4Node> nodes;
+    bool built = false, dirty = false;
+    float built_area = 0;
+
+    static bool intersects(const Aabb &box, const Frustum &frustum) {
+        for (int p = 0; p < 6; p++) {
+            float d = std::max(frustum.x[p] * box.min.x, frustum.x[p] * box.max.x) +
+                      std::max(frustum.y[p] * box.min.y, frustum.y[p] * box.max.y) +
+                      std::max(frustum.z[p] * box.min.z, frustum.z[p] * box.max.z) + frustum.w[p];
+            if (d < 0) return false;
+        }
+        return true;
+    }
+
+    // per child bit masks: entirely outside one plane, entirely inside all planes.
+    // The farthest corner along the plane normal decides outside, the nearest one inside.
+    static void test(const Bvh4Node &node, const Frustum &frustum, int &outside, int &inside) {
+#ifdef VECMATH_SSE
+        __m128 min_x = _mm_load_ps(node.min_x), min_y = _mm_load_ps(node.min_y), min_z = _mm_load_ps(node.min_z);
+        __m128 max_x = _mm_load_ps(node.max_x), max_y = _mm_load_ps(node.max_y), max_z = _mm_load_ps(node.max_z);
+        __m128 out = _mm_setzero_ps(), in = _mm_cmpeq_ps(out, out), zero = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            __m128 px = _mm_set1_ps(frustum.x[p]), py = _mm_set1_ps(frustum.y[p]), pz = _mm_set1_ps(frustum.z[p]);
+            __m128 ax = _mm_mul_ps(px, min_x), bx = _mm_mul_ps(px, max_x);
+            __m128 ay = _mm_mul_ps(py, min_y), by = _mm_mul_ps(py, max_y);
+            __m128 az = _mm_mul_ps(pz, min_z), bz = _mm_mul_ps(pz, max_z);
+            __m128 w = _mm_set1_ps(frustum.w[p]);
+            __m128 far = _mm_add_ps(_mm_add_ps(_mm_max_ps(ax, bx), _mm_max_ps(ay, by)),
+                                    _mm_add_ps(_mm_max_ps(az, bz), w));
+            __m128 near = _mm_add_ps(_mm_add_ps(_mm_min_ps(ax, bx), _mm_min_ps(ay, by)),
+                                     _mm_add_ps(_mm_min_ps(az, bz), w));
+            out = _mm_or_ps(out, _mm_cmplt_ps(far, zero));
+            in = _mm_and_ps(in, _mm_cmpge_ps(near, zero));
+        }
+        outside = _mm_movemask_ps(out);
+        inside = _mm_movemask_ps(in);
+#else
+        outside = 0;
+        inside = 0xf;
+        for (int i = 0; i < 4; i++) {
+            for (int p = 0; p < 6; p++) {
+                float ax = frustum.x[p] * node.min_x[i], bx = frustum.x[p] * node.max_x[i];
+                float ay = frustum.y[p] * node.min_y[i], by = frustum.y[p] * node.max_y[i];
+                float az = frustum.z[p] * node.min_z[i], bz = frustum.z[p] * node.max_z[i];
+                float far = std::max(ax, bx) + std::max(ay, by) + std::max(az, bz) + frustum.w[p];
+                float near = std::min(ax, bx) + std::min(ay, by) + std::min(az, bz) + frustum.w[p];
+                if (far < 0) outside |= 1 << i;
+                if (near < 0) inside &= ~(1 << i);
+            }
+        }
+#endif
+    }
+
+    template<typename F>
+    size_t emit_all(const Bvh4Node &node, int i, F &visible) const {
+        if (node.count[i]) {
+            for (uint32_t j = 0; j < node.count[i]; j++) visible(order[node.child[i] + j]);
+            return node.count[i];
+        }
+        size_t count = 0;
+        const Bvh4Node &child = nodes[node.child[i]];
+        for (int k = 0; k < 4; k++)
+            if (child.child[k] >= 0) count += emit_all(child, k, visible);
+        return count;
+    }
+
+    Aabb range_bounds(uint32_t begin, uint32_t count) const {
+        Aabb box = bounds[order[begin]];
+        for (uint32_t j = 1; j < count; j++) box = merge(box, bounds[order[begin + j]]);
+        return box;
+    }
+
+    static Aabb node_bounds(const Bvh4Node &node) {
+        Aabb box = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+        for (int i = 0; i < 4; i++) {
+            if (node.child[i] < 0) continue;
+            box = merge(box, {{node.min_x[i], node.min_y[i], node.min_z[i]},
+                              {node.max_x[i], node.max_y[i], node.max_z[i]}});
+        }
+        return box;
+    }
+
+    static void set_child_bounds(Bvh4Node &node, int i, const Aabb &box) {
+        node.min_x[i] = box.min.x;
+        node.min_y[i] = box.min.y;
+        node.min_z[i] = box.min.z;
+        node.max_x[i] = box.max.x;
+        node.max_y[i] = box.max.y;
+        node.max_z[i] = box.max.z;
+    }
+
+    float total_area() const {
+        float area = 0;
+        for (const Bvh4Node &node: nodes) {
+            for (int i = 0; i < 4; i++) {
+                if (node.child[i] < 0) continue;
+                area += surface_area({{node.min_x[i], node.min_y[i], node.min_z[i]},
+                                      {node.max_x[i], node.max_y[i], node.max_z[i]}});
+            }
+        }
+        return area;
+    }
+
+    // median split of order[begin, end) along the longest axis of the centers
+    uint32_t split(uint32_t begin, uint32_t end) {
+        vec3 lo = centers[order[begin]], hi = lo;
+        for (uint32_t j = begin + 1; j < end; j++) {
+            vec3 c = centers[order[j]];
+            lo = {std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z)};
+            hi = {std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z)};
+        }
+        vec3 extent = hi - lo;
+        int axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+        uint32_t middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](uint32_t a, uint32_t b) {
+                             const float *ca = &centers[a].x, *cb = &centers[b].x;
+                             return ca[axis] < cb[axis];
+                         });
+        return middle;
+    }
+
+    // two levels of binary splits make up to four children, depth stays ~log4(n) so the traversal stack is small
+    int32_t build_node(uint32_t begin, uint32_t end) {
+        auto index = (int32_t) nodes.size();
+        nodes.emplace_back();
+        std::pair<uint32_t, uint32_t> ranges[4] = {{begin, end}};
+        int range_count = 1;
+        while (range_count < 4) {
+            int largest = -1;
+            for (int r = 0; r < range_count; r++) {
+                uint32_t n = ranges[r].second - ranges[r].first;
+                if (n > leaf_size && (largest < 0 || n > ranges[largest].second - ranges[largest].first))
+                    largest = r;
+            }
+            if (largest < 0) break;
+            uint32_t middle = split(ranges[largest].first, ranges[largest].second);
+            ranges[range_count++] = {middle, ranges[largest].second};
+            ranges[largest].second = middle;
+        }
+
+        Bvh4Node node{};
+        for (int i = 0; i < 4; i++) {
+            node.child[i] = -1;
+            node.count[i] = 0;
+        }
+        for (int i = 0; i < range_count; i++) {
+            uint32_t n = ranges[i].second - ranges[i].first;
+            if (n <= leaf_size) {
+                node.child[i] = (int32_t) ranges[i].first;
+                node.count[i] = n;
+                set_child_bounds(node, i, range_bounds(ranges[i].first, n));
+            } else {
+                node.child[i] = build_node(ranges[i].first, ranges[i].second);
+                set_child_bounds(node, i, node_bounds(nodes[node.child[i]]));
+            }
+        }
+        nodes[index] = node;
+        return index;
+    }
+};
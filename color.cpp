@@ -4,6 +4,8 @@
 #include <iostream>
 #include <filesystem>
 
+#include "shader_manager.h"
+
 int main() {
     std::cout << "Current working directory: " << std::filesystem::current_path() << std::endl;
 
@@ -28,37 +30,12 @@ int main() {
     glewExperimental = GL_TRUE;
     glewInit();
 
-    // shaders
-    const char *vertexShaderSource = R"###(
-            #version 300 es
-            in vec3 aPos;
-            void main() {
-                gl_Position = vec4(aPos, 1.0);
-            }
-    )###";
-
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-
-    const char *fragmentShaderSource = R"###(
-            #version 300 es
-            out lowp vec4 fragColor;
-            void main() {
-                fragColor = vec4(1.0, 0.0, 0.0, 1.0);
-            }
-    )###";
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
-    glCompileShader(fragmentShader);
-
-
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    glUseProgram(shaderProgram);
+    // shaders, from files and recompiled when they change
+    ShaderManager shaders;
+    ShaderManager::Handle red = shaders.load("../shaders/red.vert", "../shaders/red.frag", [](GLuint id) {
+        glBindAttribLocation(id, 0, "aPos");
+    });
+    shaders.watch("../shaders");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -95,7 +72,9 @@ int main() {
     while (!glfwWindowShouldClose(window)) {
         // render
         // ------
-        glUseProgram(shaderProgram);
+        // picks up a reloaded program, nothing is drawn while the first one failed
+        shaders.update();
+        glUseProgram(shaders.get(red));
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 
@@ -110,6 +89,7 @@ int main() {
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
+    shaders.release();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -4,97 +4,37 @@
 #include <iostream>
 #include <filesystem>
 #include <cmath>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "primitives.h"
+#include "uniform_ring.h"
+#include "vertex_format.h"
+#include "bvh.h"
+#include "indirect_draw.h"
+#include "shader_permutation.h"
+#include "program_reflection.h"
+#include "gl_state.h"
+#include "render_graph.h"
 
-GLuint MatrixID;
 unsigned int program;
 unsigned int VAO;
 
-void setup_cube() {
-    // shaders
-    const char *vertexShaderSource = R"###(
-            #version 300 es
-            in highp vec3 pos;
-            in lowp vec3 color;
-            out lowp vec4 ocolor;
-            uniform mat4 MVP;
-            void main() {
-                gl_Position = MVP * vec4(pos, 1.0);
-                ocolor = vec4(color, 1.0);
-            }
-    )###";
-
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-
-    const char *fragmentShaderSource = R"###(
-            #version 300 es
-            out lowp vec4 fragColor;
-            in lowp vec4 ocolor;
-            void main() {
-                fragColor = ocolor;
-            }
-    )###";
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
-    glCompileShader(fragmentShader);
-
-    program = glCreateProgram();
-    glBindAttribLocation(program, 0, "pos");
-    glBindAttribLocation(program, 1, "color");
-    glAttachShader(program, vertexShader);
-    glAttachShader(program, fragmentShader);
-    glBindFragDataLocation(program, 0, "fragColor");
-    glLinkProgram(program);
+// the two surface permutations this demo compiles
+constexpr uint32_t cubeSurface = SurfaceVertexColor | SurfaceTransform;
+constexpr uint32_t quadSurface = SurfaceTextured;
 
-    std::cout << glGetError() << std::endl;
-
-    glUseProgram(program);
+VertexFormat setup_cube(ShaderPermutations &surfaces) {
+    // compiled in the background, camera and object constants come from the shared uniform ring
+    surfaces.require(cubeSurface);
 
-    // Get a handle for our "MVP" uniform
-    MatrixID = glGetUniformLocation(program, "MVP");
+    std::cout << glGetError() << std::endl;
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
-    float vertices[] = {
-            -1.0f, -1.0f, -1.0f, // triangle 1 : begin
-            -1.0f, -1.0f, 1.0f,
-            -1.0f, 1.0f, 1.0f, // triangle 1 : end
-            1.0f, 1.0f, -1.0f, // triangle 2 : begin
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, 1.0f, -1.0f, // triangle 2 : end
-            1.0f, -1.0f, 1.0f,
-            -1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, 1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, 1.0f, 1.0f,
-            -1.0f, 1.0f, -1.0f,
-            1.0f, -1.0f, 1.0f,
-            -1.0f, -1.0f, 1.0f,
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, 1.0f, 1.0f,
-            -1.0f, -1.0f, 1.0f,
-            1.0f, -1.0f, 1.0f,
-            1.0f, 1.0f, 1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, 1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, 1.0f, 1.0f,
-            1.0f, -1.0f, 1.0f,
-            1.0f, 1.0f, 1.0f,
-            1.0f, 1.0f, -1.0f,
-            -1.0f, 1.0f, -1.0f,
-            1.0f, 1.0f, 1.0f,
-            -1.0f, 1.0f, -1.0f,
-            -1.0f, 1.0f, 1.0f,
-            1.0f, 1.0f, 1.0f,
-            -1.0f, 1.0f, 1.0f,
-            1.0f, -1.0f, 1.0f
-    };
+    // 24 shared vertices + 36 16 bit indices, generated at compile time
+    const auto &cube = cube_primitive;
 
     // One color for each vertex. They were generated randomly.
     static const GLfloat g_color_buffer_data[] = {
@@ -121,36 +61,29 @@ void setup_cube() {
             0.543f, 0.021f, 0.978f,
             0.279f, 0.317f, 0.505f,
             0.167f, 0.620f, 0.077f,
-            0.347f, 0.857f, 0.137f,
-            0.055f, 0.953f, 0.042f,
-            0.714f, 0.505f, 0.345f,
-            0.783f, 0.290f, 0.734f,
-            0.722f, 0.645f, 0.174f,
-            0.302f, 0.455f, 0.848f,
-            0.225f, 0.587f, 0.040f,
-            0.517f, 0.713f, 0.338f,
-            0.053f, 0.959f, 0.120f,
-            0.393f, 0.621f, 0.362f,
-            0.673f, 0.211f, 0.457f,
-            0.820f, 0.883f, 0.371f,
-            0.982f, 0.099f, 0.879f
+            0.347f, 0.857f, 0.137f
     };
 
-    unsigned int VBO, colorbuffer;
+    // one interleaved buffer: position as normalized shorts (the cube spans [-1, 1], w = 1 pads to 8 bytes),
+    // color as normalized bytes, 12 bytes per vertex instead of 32 + 12 in two buffers
+    VertexFormat format;
+    format.add(SurfacePosition, 4, VertexType::Snorm16).add(SurfaceColor, 4, VertexType::Unorm8);
+    std::vector<unsigned char> vertexData = interleave(
+            format, cube.vertices.size(),
+            {{cube.vertices.data(), 3, sizeof(PrimitiveVertex), offsetof(PrimitiveVertex, position)},
+             {g_color_buffer_data, 3}});
+
+    unsigned int VBO, EBO;
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
     glGenBuffers(1, &VBO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glGenBuffers(1, &colorbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, colorbuffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(g_color_buffer_data), g_color_buffer_data, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, colorbuffer);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube.indices), cube.indices.data(), GL_STATIC_DRAW);
+    format.apply();
+    return format;
 }
 
 int main() {
@@ -178,93 +111,20 @@ int main() {
     glewInit();
 
     // Enable depth test
-    glEnable(GL_DEPTH_TEST);
+    gl_state.depth_test(true);
     // Accept fragment if it closer to the camera than the former one
-    glDepthFunc(GL_LESS);
+    gl_state.depth_func(GL_LESS);
 
-    setup_cube();
+    // every program is submitted up front and only waited for at first use, after the rest of the setup
+    ShaderManager shaders;
+    ShaderPermutations surfaces = surface_permutations(shaders);
+    VertexFormat cubeFormat = setup_cube(surfaces);
 
     /**
      * Render to Texture
      * */
 
-    // shaders
-    const char *vertexShaderSource = R"###(
-            #version 300 es
-            out highp vec2 texCoord;
-            in highp vec3 pos;
-            in highp vec2 aTexCoord;
-
-            void main() {
-                gl_Position = vec4(pos, 1.0);
-                texCoord = aTexCoord;
-            }
-    )###";
-
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-
-    const char *fragmentShaderSource = R"###(
-            #version 300 es
-            out lowp vec4 fragColor;
-            in highp vec2 texCoord;
-            uniform sampler2D t;
-
-            void main() {
-                fragColor = texture(t, texCoord);
-            }
-    )###";
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
-    glCompileShader(fragmentShader);
-
-    unsigned int program2 = glCreateProgram();
-    glBindAttribLocation(program2, 0, "pos");
-    glBindAttribLocation(program2, 1, "aTexCoord");
-    glAttachShader(program2, vertexShader);
-    glAttachShader(program2, fragmentShader);
-    glBindFragDataLocation(program2, 0, "fragColor");
-    glLinkProgram(program2);
-    glUseProgram(program2);
-
-    GLuint FBO = 0;
-    glGenFramebuffers(1, &FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-
-    // The texture we're going to render to
-    GLuint renderedTexture;
-    glGenTextures(1, &renderedTexture);
-
-    // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, renderedTexture);
-
-    // Give an empty image to OpenGL ( the last "0" )
-    int width = 256;
-    int height = 256;
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // The depth buffer
-    GLuint depthrenderbuffer;
-    glGenRenderbuffers(1, &depthrenderbuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthrenderbuffer);
-
-    // Set "renderedTexture" as our colour attachement #0
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderedTexture, 0);
-
-//    // Set the list of draw buffers.
-//    GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
-//    glDrawBuffers(1, DrawBuffers); // "1" is the size of DrawBuffers
-
-    // Always check that our framebuffer is ok
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        return 166;
+    surfaces.require(quadSurface);
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -295,30 +155,122 @@ int main() {
             5, 6, 7,  // second triangle
     };
 
-    unsigned int VBO2, VAO2, EBO2, TEXCOORD;
+    // interleaved like the cube: normalized short positions, normalized unsigned short texture coords
+    VertexFormat quadFormat;
+    quadFormat.add(SurfacePosition, 4, VertexType::Snorm16).add(SurfaceUv, 2, VertexType::Unorm16);
+    std::vector<unsigned char> quadData = interleave(quadFormat, 8, {{vertices, 3}, {texCoords, 2}});
+    IndexData quadIndices = pack_indices(indices, sizeof(indices) / sizeof(indices[0]));
+
+    unsigned int VBO2, VAO2, EBO2;
     glGenVertexArrays(1, &VAO2);
     glGenBuffers(1, &VBO2);
     glGenBuffers(1, &EBO2);
-    glGenBuffers(1, &TEXCOORD);
 
     glBindVertexArray(VAO2);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO2);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) quadData.size(), quadData.data(), GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO2);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, TEXCOORD);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(texCoords), texCoords, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) quadIndices.bytes.size(), quadIndices.bytes.data(),
+                 GL_STATIC_DRAW);
+
+    quadFormat.apply();
+
+
+    // per-frame constants, written once per frame and bound by range for every program,
+    // big enough for one ObjectBlock per cube
+    UniformRing uniforms(4 << 20);
+    mat4 projection = perspective(45.0f, 1.0f, 0.1f, 100.0f);
+
+    // a field of cubes with the original one at the origin, the camera orbits that one.
+    // Every 16th cube bobs up and down so the culling hierarchy gets refit every frame.
+    const int side = 100;
+    const Aabb cubeBounds = {{-1, -1, -1}, {1, 1, 1}};
+    std::vector<ObjectBlock> cubes;
+    std::vector<vec3> cubePositions;
+    Bvh bvh;
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            vec3 position = {(float) (x - side / 2) * 4, 0, (float) (z - side / 2) * 4};
+            cubes.push_back({translate(position)});
+            cubePositions.push_back(position);
+            bvh.add(transform_aabb(cubes.back().model, cubeBounds));
+        }
+    }
+    size_t visibleCubes = 0;
+
+    // GPU-driven path when available: a compute shader culls the cubes and one multi draw indirect draws them,
+    // the cube's model matrix comes from the scene's Models buffer instead of the Object block
+    std::unique_ptr<IndirectScene> scene;
+    if (IndirectScene::supported()) scene = std::make_unique<IndirectScene>();
+    bool gpuDriven = scene && scene->valid();
+    ShaderManager::Handle indirectShader = 0;
+    if (gpuDriven) {
+        indirectShader = shaders.load("../shaders/cube_indirect.vert", "../shaders/vertex_color_indirect.frag", {},
+                                      bind_uniform_blocks);
+    }
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO2);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, TEXCOORD);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+    // first use of the programs, only waits for whatever the driver has not finished yet
+    program = surfaces.get(cubeSurface);
+    surfaces.get(quadSurface);
+    gpuDriven = gpuDriven && shaders.get(indirectShader) != 0;
+    // what the surface programs read, checked against the vertex formats whenever a program is (re)linked
+    ProgramReflection cubeReflection, quadReflection;
+    const GLint textureUnit = 0;
+    int quadSamplerSlot = -1; // slot("t"), looked up again after every relink
+    // every program used by the loop below is looked up per frame, edits to the files get swapped in
+    shaders.watch("../shaders");
+    if (gpuDriven) {
+        DrawElementsIndirectCommand draw = {(GLuint) cube_primitive.indices.size(), 0, 0, 0, 0};
+        for (uint32_t i = 0; i < cubes.size(); i++) scene->add(draw, cubes[i].model, bvh.get(i));
+        scene->attach(VAO, 3);
+    }
 
+    // the cubes render into a transient target that the second pass samples onto the backbuffer. The graph owns
+    // the textures and framebuffers, clears both targets before the cube pass and discards the depth after it;
+    // state the previous pass left bound only goes to the driver when it differs
+    CameraBlock camera = {};
+    RenderGraph graph;
+    RenderResource sceneColor = graph.create("scene color", {256, 256, GL_RGBA8});
+    RenderResource sceneDepth = graph.create("scene depth", {256, 256, GL_DEPTH_COMPONENT24});
+    RenderResource screen = graph.backbuffer(1000, 1000);
+    graph.add_pass("cubes", {}, {sceneColor, sceneDepth}, [&]() {
+        if (gpuDriven) {
+            scene->cull(camera.viewProjection);
+            gl_state.use_program(shaders.get(indirectShader));
+            gl_state.bind_vertex_array(VAO);
+            scene->draw(GL_UNSIGNED_SHORT);
+        } else {
+            program = surfaces.get(cubeSurface);
+            gl_state.use_program(program);
+            if (cubeReflection.sync(program)) cubeReflection.matches(cubeFormat);
+            gl_state.bind_vertex_array(VAO);
+            // only cubes whose bounds touch the view frustum are drawn
+            visibleCubes = bvh.cull(frustum_from(camera.viewProjection), [&](uint32_t id) {
+                // the frame's uniform region is full, the cube would be drawn with the previous one's model
+                if (!uniforms.set(ObjectBinding, cubes[id])) return;
+                glDrawElements(GL_TRIANGLES, (GLsizei) cube_primitive.indices.size(), GL_UNSIGNED_SHORT, nullptr);
+            });
+        }
+    });
+    graph.add_pass("present", {sceneColor}, {screen}, [&]() {
+        GLuint quadProgram = surfaces.get(quadSurface);
+        gl_state.use_program(quadProgram);
+        if (quadReflection.sync(quadProgram)) {
+            quadReflection.matches(quadFormat);
+            quadSamplerSlot = quadReflection.slot("t");
+        }
+        quadReflection.set(quadSamplerSlot, textureUnit);
+        gl_state.bind_vertex_array(VAO2);
+        gl_state.bind_texture(textureUnit, GL_TEXTURE_2D, graph.texture(sceneColor));
+        glDrawElements(GL_TRIANGLES, (GLsizei) quadIndices.count, quadIndices.type, nullptr);
+    });
+    // Always check that our framebuffer is ok
+    if (!graph.compile()) {
+        glfwTerminate();
+        return 166;
+    }
 
     // render loop
     // -----------
@@ -329,40 +281,36 @@ int main() {
         nbFrames++;
         if (currentTime - lastTime >= 1.0) { // If last prinf() was more than 1 sec ago
             // printf and reset timer
-            printf("%f fps\n", double(nbFrames));
+            if (gpuDriven) printf("%f fps, %zu cubes culled on the GPU", double(nbFrames), cubes.size());
+            else printf("%f fps, %zu / %zu cubes visible", double(nbFrames), visibleCubes, cubes.size());
+            printf(", %d GL calls issued, %d skipped last frame\n", gl_state.last_issued, gl_state.last_saved);
             nbFrames = 0;
             lastTime += 1.0;
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-        glViewport(0, 0, width, height);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glUseProgram(program);
-
-        double diff = (currentTime - (int) currentTime) * 2 * M_PI;
-        glPushMatrix();
-        glLoadIdentity();
-        gluPerspective(45.0f, 1.0f, 0.1f, 100.0f);
-        gluLookAt(4 * sin(diff), 3, -4 * cos(diff), 0, 0, 0, 0, 1, 0);
-
-        glBindVertexArray(VAO);
-        float MVP[16];
-        glGetFloatv(GL_MODELVIEW_MATRIX, MVP);
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, MVP);
-        glPopMatrix();
-        glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
+        shaders.update();
+        uniforms.begin_frame();
+
+        // camera on the CPU, no fixed-function matrix stack or GL readback
+        float diff = (float) (currentTime - (int) currentTime) * 2 * (float) M_PI;
+        vec3 eye = {4 * std::sin(diff), 3, -4 * std::cos(diff)};
+        camera = {projection * look_at(eye, {0, 0, 0}, {0, 1, 0})};
+
+        for (size_t i = 0; i < cubes.size(); i += 16) {
+            vec3 position = cubePositions[i];
+            position.y = std::sin((float) currentTime * 2 + (float) i);
+            cubes[i].model = translate(position);
+            Aabb bounds = transform_aabb(cubes[i].model, cubeBounds);
+            if (gpuDriven) scene->update((uint32_t) i, cubes[i].model, bounds);
+            else bvh.update((uint32_t) i, bounds);
+        }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, 1000, 1000);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUseProgram(program2);
-        glBindVertexArray(VAO2);
-        glBindTexture(GL_TEXTURE_2D, renderedTexture);
-        glDrawElements(GL_TRIANGLES, 12, GL_UNSIGNED_INT, nullptr);
+        // without this frame's camera (the wait for its uniform region failed) the frame is not drawn
+        if (uniforms.set(CameraBinding, camera)) graph.execute();
 
-        glUseProgram(0);
-        glBindVertexArray(0);
+        // bindings stay as they are for the next frame, the state cache skips what is unchanged
+        uniforms.end_frame();
+        gl_state.end_frame();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -373,7 +321,12 @@ int main() {
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &VAO);
+    gl_state.forget_vertex_array(VAO);
 //    glDeleteBuffers(1, &VBO);
+    uniforms.release();
+    if (scene) scene->release();
+    graph.release();
+    shaders.release();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// reports files written or moved into one directory, inotify on a background thread (linux only,
+// available() is false elsewhere). Paths come back as directory / name, lexically normalized.
+class FileWatcher {
+public:
+    explicit FileWatcher(const std::string &directory) : directory(directory) {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return;
+        // editors either rewrite the file or write a new one and rename it over the old
+        if (inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close(fd);
+            fd = -1;
+            return;
+        }
+        running = true;
+        thread = std::thread([this] { run(); });
+#endif
+    }
+
+    FileWatcher(const FileWatcher &) = delete;
+
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    ~FileWatcher() {
+        stop();
+    }
+
+    bool available() const {
+        return fd >= 0;
+    }
+
+    void stop() {
+        running = false;
+        if (thread.joinable()) thread.join();
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+        fd = -1;
+    }
+
+    // files changed since the last call
+    std::vector<std::string> changed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> files(pending.begin(), pending.end());
+        pending.clear();
+        return files;
+    }
+
+private:
+    std::string directory;
+    int fd = -1;
+    std::atomic<bool> running{false};
+    std::thread thread;
+    std::mutex mutex;
+    std::set<std::string> pending;
+
+    void run() {
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+        while (running) {
+            // wake up now and then to notice stop()
+            pollfd p = {fd, POLLIN, 0};
+            if (poll(&p, 1, 100) <= 0) continue;
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            for (ssize_t offset = 0; offset < length;) {
+                auto *event = (const inotify_event *) (buffer + offset);
+                if (event->len) {
+                    std::string path = (std::filesystem::path(directory) / event->name).lexically_normal().string();
+                    std::lock_guard<std::mutex> lock(mutex);
+                    pending.insert(path);
+                }
+                offset += (ssize_t) (sizeof(inotify_event) + event->len);
+            }
+        }
+#endif
+    }
+};
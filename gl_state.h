@@ -0,0 +1,313 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+
+/**
+ * Shadow copy of the context's binding and fixed-function state, so setting something to what it already is costs
+ * a compare instead of a driver call. Covers the program, VAO, framebuffer, viewport, depth and blend state, the
+ * color and depth write masks, the texture bound to each unit and the generic and indexed buffer bindings of the
+ * targets the render loops use.
+ *
+ * Everything starts out unknown, so the first call of each kind always goes out and setup code that binds
+ * directly before the render loop is harmless. Code that binds behind its back later (texture uploads on the main
+ * thread, other libraries) has to call invalidate() afterwards, and code that deletes an object the matching
+ * forget_*(), or a new object that is given the recycled name would look bound already. One instance per context:
+ * the upload thread's context has its own state and does not use gl_state.
+ *
+ * issued / saved count the calls of the current frame, end_frame() moves them to last_issued / last_saved.
+ * */
+
+class GlState {
+public:
+    static constexpr int max_units = 16;
+    static constexpr int max_indexed = 16;
+
+    int issued = 0, saved = 0;
+    int last_issued = 0, last_saved = 0;
+
+    GlState() {
+        invalidate();
+    }
+
+    // forget everything, the next call of each kind goes out
+    void invalidate() {
+        program = vao = framebuffer = unknown;
+        viewportRect[0] = viewportRect[1] = viewportRect[2] = viewportRect[3] = -1;
+        depthTest = blend = cullFace = -1;
+        colorWrites = depthWrites = -1;
+        depthFunction = unknown;
+        blendSource = blendDestination = unknown;
+        activeUnit = unknown;
+        for (int unit = 0; unit < max_units; unit++) {
+            for (GLuint &texture: textures[unit]) texture = unknown;
+        }
+        for (int target = 0; target < target_count; target++) {
+            buffers[target] = unknown;
+            for (IndexedBinding &binding: indexed[target]) binding = {unknown, 0, 0};
+        }
+    }
+
+    // after glDeleteTextures, the units it was bound to go out again on their next bind
+    void forget_texture(GLuint texture) {
+        for (int unit = 0; unit < max_units; unit++) {
+            for (GLuint &bound: textures[unit]) {
+                if (bound == texture) bound = unknown;
+            }
+        }
+    }
+
+    // after glDeleteFramebuffers
+    void forget_framebuffer(GLuint id) {
+        if (framebuffer == id) framebuffer = unknown;
+    }
+
+    // after glDeleteProgram, a current program stays in use until another one is, but its name can be reused
+    void forget_program(GLuint id) {
+        if (program == id) program = unknown;
+    }
+
+    // after glDeleteVertexArrays
+    void forget_vertex_array(GLuint id) {
+        if (vao == id) vao = unknown;
+    }
+
+    // after glDeleteBuffers, generic and indexed bindings alike
+    void forget_buffer(GLuint buffer) {
+        for (int target = 0; target < target_count; target++) {
+            if (buffers[target] == buffer) buffers[target] = unknown;
+            for (IndexedBinding &binding: indexed[target]) {
+                if (binding.buffer == buffer) binding = {unknown, 0, 0};
+            }
+        }
+    }
+
+    void end_frame() {
+        last_issued = issued;
+        last_saved = saved;
+        issued = saved = 0;
+    }
+
+    void use_program(GLuint id) {
+        if (changed(program, id)) glUseProgram(id);
+    }
+
+    void bind_vertex_array(GLuint id) {
+        if (changed(vao, id)) glBindVertexArray(id);
+    }
+
+    // draw and read framebuffer together
+    void bind_framebuffer(GLuint id) {
+        if (changed(framebuffer, id)) glBindFramebuffer(GL_FRAMEBUFFER, id);
+    }
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+        if (viewportRect[0] == x && viewportRect[1] == y && viewportRect[2] == width && viewportRect[3] == height) {
+            saved++;
+            return;
+        }
+        viewportRect[0] = x;
+        viewportRect[1] = y;
+        viewportRect[2] = width;
+        viewportRect[3] = height;
+        issued++;
+        glViewport(x, y, width, height);
+    }
+
+    void depth_test(bool enabled) {
+        capability(depthTest, GL_DEPTH_TEST, enabled);
+    }
+
+    void blending(bool enabled) {
+        capability(blend, GL_BLEND, enabled);
+    }
+
+    void cull_face(bool enabled) {
+        capability(cullFace, GL_CULL_FACE, enabled);
+    }
+
+    // all four channels together
+    void color_mask(bool enabled) {
+        if (!changed(colorWrites, (int) enabled)) return;
+        GLboolean mask = enabled ? GL_TRUE : GL_FALSE;
+        glColorMask(mask, mask, mask, mask);
+    }
+
+    void depth_mask(bool enabled) {
+        if (changed(depthWrites, (int) enabled)) glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+
+    // the cached masks, -1 while unknown
+    int color_writes() const {
+        return colorWrites;
+    }
+
+    int depth_writes() const {
+        return depthWrites;
+    }
+
+    void depth_func(GLenum function) {
+        if (changed(depthFunction, function)) glDepthFunc(function);
+    }
+
+    void blend_func(GLenum source, GLenum destination) {
+        if (blendSource == source && blendDestination == destination) {
+            saved++;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        issued++;
+        glBlendFunc(source, destination);
+    }
+
+    // also makes unit the active one, bound or not, so glTex* calls that follow act on this texture
+    void bind_texture(GLuint unit, GLenum target, GLuint texture) {
+        active_texture(unit);
+        int slot = texture_slot(target);
+        if (unit >= (GLuint) max_units || slot < 0) {
+            issued++;
+            glBindTexture(target, texture);
+            return;
+        }
+        if (textures[unit][slot] == texture) {
+            saved++;
+            return;
+        }
+        textures[unit][slot] = texture;
+        issued++;
+        glBindTexture(target, texture);
+    }
+
+    void active_texture(GLuint unit) {
+        if (changed(activeUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // generic binding point, GL_ELEMENT_ARRAY_BUFFER is VAO state and not cached
+    void bind_buffer(GLenum target, GLuint buffer) {
+        int slot = buffer_slot(target);
+        if (slot < 0) {
+            issued++;
+            glBindBuffer(target, buffer);
+            return;
+        }
+        if (changed(buffers[slot], buffer)) glBindBuffer(target, buffer);
+    }
+
+    // indexed binding point, which also sets the generic one
+    void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+        int slot = buffer_slot(target);
+        if (slot < 0 || index >= (GLuint) max_indexed) {
+            if (slot >= 0) buffers[slot] = buffer;
+            issued++;
+            glBindBufferRange(target, index, buffer, offset, size);
+            return;
+        }
+        IndexedBinding &binding = indexed[slot][index];
+        if (binding.buffer == buffer && binding.offset == offset && binding.size == size) {
+            saved++;
+            return;
+        }
+        binding = {buffer, offset, size};
+        buffers[slot] = buffer;
+        issued++;
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+
+    // the whole buffer, kept apart from ranges by a size of -1
+    void bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+        int slot = buffer_slot(target);
+        if (slot < 0 || index >= (GLuint) max_indexed) {
+            if (slot >= 0) buffers[slot] = buffer;
+            issued++;
+            glBindBufferBase(target, index, buffer);
+            return;
+        }
+        IndexedBinding &binding = indexed[slot][index];
+        if (binding.buffer == buffer && binding.size == -1) {
+            saved++;
+            return;
+        }
+        binding = {buffer, 0, -1};
+        buffers[slot] = buffer;
+        issued++;
+        glBindBufferBase(target, index, buffer);
+    }
+
+private:
+    static constexpr GLuint unknown = 0xffffffffu;
+
+    enum BufferTarget {
+        array_target, uniform_target, storage_target, indirect_target, target_count
+    };
+
+    struct IndexedBinding {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    GLuint program = unknown, vao = unknown, framebuffer = unknown;
+    GLint viewportRect[4] = {-1, -1, -1, -1};
+    int depthTest = -1, blend = -1, cullFace = -1; // -1 unknown
+    int colorWrites = -1, depthWrites = -1;
+    GLenum depthFunction = unknown, blendSource = unknown, blendDestination = unknown;
+    GLuint activeUnit = unknown;
+    GLuint textures[max_units][3] = {};
+    GLuint buffers[target_count] = {};
+    IndexedBinding indexed[target_count][max_indexed] = {};
+
+    template<typename T>
+    bool changed(T &current, T value) {
+        if (current == value) {
+            saved++;
+            return false;
+        }
+        current = value;
+        issued++;
+        return true;
+    }
+
+    void capability(int &current, GLenum cap, bool enabled) {
+        if (current == (int) enabled) {
+            saved++;
+            return;
+        }
+        current = enabled;
+        issued++;
+        if (enabled) glEnable(cap);
+        else glDisable(cap);
+    }
+
+    static int texture_slot(GLenum target) {
+        switch (target) {
+            case GL_TEXTURE_2D:
+                return 0;
+            case GL_TEXTURE_2D_ARRAY:
+                return 1;
+            case GL_TEXTURE_CUBE_MAP:
+                return 2;
+            default:
+                return -1;
+        }
+    }
+
+    static int buffer_slot(GLenum target) {
+        switch (target) {
+            case GL_ARRAY_BUFFER:
+                return array_target;
+            case GL_UNIFORM_BUFFER:
+                return uniform_target;
+            case GL_SHADER_STORAGE_BUFFER:
+                return storage_target;
+            case GL_DRAW_INDIRECT_BUFFER:
+                return indirect_target;
+            default:
+                return -1;
+        }
+    }
+};
+
+// the main context's state
+inline GlState gl_state;
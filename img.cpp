@@ -4,11 +4,22 @@
 #include <iostream>
 #include <filesystem>
 #include <ctime>
+#include <memory>
 #include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "stb_image.h"
+#include "texture.h"
+#include "bc.h"
+#include "material.h"
+#include "mipmap.h"
+#include "pbo_ring.h"
+#include "upload_thread.h"
+#include "quad_batch.h"
+#include "shader_manager.h"
+#include "texture_array.h"
+#include "gl_state.h"
 
 int main() {
     std::cout << "Current working directory: " << std::filesystem::current_path() << std::endl;
@@ -34,184 +45,157 @@ int main() {
     glewExperimental = GL_TRUE;
     glewInit();
 
-    // shaders
-    const char *vertexShaderSource = R"###(
-            #version 300 es
-            #extension GL_ARB_explicit_attrib_location : enable
-            layout (location = 0) in vec3 aPos;
-            layout (location = 1) in vec2 aTexCoord;
-            out vec2 texCoord;
-
-            void main() {
-                gl_Position = vec4(aPos, 1.0);
-                texCoord = aTexCoord;
-            }
-    )###";
-
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-
-    GLint isCompiled = 0;
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &isCompiled);
-    if (isCompiled == GL_FALSE) {
-        GLint maxLength = 0;
-        glGetShaderiv(vertexShader, GL_INFO_LOG_LENGTH, &maxLength);
-
-        // The maxLength includes the NULL character
-        std::vector<GLchar> errorLog(maxLength);
-        glGetShaderInfoLog(vertexShader, maxLength, &maxLength, &errorLog[0]);
-
-        // Provide the infolog in whatever manor you deem best.
-        std::cout << errorLog.data() << std::endl;
-        // Exit with failure.
-        glDeleteShader(vertexShader); // Don't leak the shader.
+    // the batch programs are loaded from ../shaders and hot-reloaded on change
+    ShaderManager shaders;
+    // all quads go out in one instanced draw that picks the texture per instance: with bindless textures from the
+    // textures of the material table, otherwise from the layers of one texture array the images are loaded into
+    QuadBatch batch(shaders);
+    // first use, compile errors are printed
+    if (!batch.valid()) {
+        glfwTerminate();
         return 114;
     }
-
-    const char *fragmentShaderSource = R"###(
-            #version 300 es
-            out lowp vec4 fragColor;
-            in highp vec2 texCoord;
-            uniform sampler2D t;
-
-            void main() {
-                fragColor = texture(t, texCoord);
-            }
-    )###";
-
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
-    glCompileShader(fragmentShader);
-
-    isCompiled = 0;
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &isCompiled);
-    if (isCompiled == GL_FALSE) {
-        GLint maxLength = 0;
-        glGetShaderiv(fragmentShader, GL_INFO_LOG_LENGTH, &maxLength);
-
-        // The maxLength includes the NULL character
-        std::vector<GLchar> errorLog(maxLength);
-        glGetShaderInfoLog(fragmentShader, maxLength, &maxLength, &errorLog[0]);
-
-        // Provide the infolog in whatever manor you deem best.
-        std::cout << errorLog.data() << std::endl;
-        // Exit with failure.
-        glDeleteShader(fragmentShader); // Don't leak the shader.
-        return 115;
-    }
-
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    glUseProgram(shaderProgram);
-
-    // set up vertex data (and buffer(s)) and configure vertex attributes
-    // ------------------------------------------------------------------
-    float vertices[] = {
-            // positions                    // texture coords
-            -0.6f, 0.8f, 0.0f, 1.0f, 0.0f, // top right
-            -0.6f, 0.6f, 0.0f, 1.0f, 1.0f, // bottom right
-            -0.8f, 0.6f, 0.0f, 0.0f, 1.0f, // bottom left
-            -0.8f, 0.8f, 0.0f, 0.0f, 0.0f,  // top left
-            -0.4f, 0.8f, 0.0f, 1.0f, 0.0f, // top right
-            -0.4f, 0.6f, 0.0f, 1.0f, 1.0f, // bottom right
-            -0.6f, 0.6f, 0.0f, 0.0f, 1.0f, // bottom left
-            -0.6f, 0.8f, 0.0f, 0.0f, 0.0f  // top left
-    };
-    unsigned int indices[] = {
-            0, 1, 3, // first triangle
-            1, 2, 3,  // second triangle
-            4, 5, 7, // first triangle
-            5, 6, 7  // second triangle
-    };
-
-    unsigned int VBO, VAO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) nullptr);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
+    shaders.watch("../shaders");
+    bool bindless = BindlessTextures::supported();
+    BindlessTextures handles;
+    const int imageSize = 256;
 
     // load and create a texture
     // -------------------------
 
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D,
-                  texture); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-    // load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load("../256g.jpg", &width, &height,
-                                    &nrChannels, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    } else {
-        std::cout << "Failed to load texture" << std::endl;
+    // block compress (BC1/BC3/BC4/BC5, BC7 for colour where supported) on the CPU when the driver can sample it,
+    // the whole mip chain is cached next to the source image. Array layers are all BC3 (or BC7)
+    bool compress = bc_supported();
+    bool bc7 = compress && bc7_supported();
+    std::unique_ptr<TextureArray> layers;
+    if (!bindless)
+        layers = std::make_unique<TextureArray>(imageSize, imageSize, 3, compress ? bc_format(4, bc7) : GL_RGBA8);
+
+    // images are decoded, compressed, mipmapped and uploaded on a worker with a shared context (or taken as they are
+    // from a .ktx2 / .dds of the same name), the quads show nothing until their texture is ready
+    UploadThread uploader(window);
+    if (!uploader.available()) {
+        std::cout << "Failed to create upload context" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    int id = 0;
+    for (const char *path: {"../256g.jpg", "../256.jpg"}) {
+        UploadRequest request{id++, path, compress, bc7};
+        if (layers) {
+            request.array = layers->texture();
+            request.layer = layers->reserve();
+        }
+        uploader.submit(request);
     }
-//    stbi_image_free(data);
-
-    // texture 2
-    unsigned int texture2;
-    glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    unsigned char *data2 = stbi_load("../256.jpg", &width, &height, &nrChannels, 0);
-    if (data2) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data2);
+
+    // the third quad shows an image generated on the CPU every frame, streamed with its mip levels through a
+    // persistently mapped PBO ring (or from client memory without GL_ARB_buffer_storage). In a compressed array the
+    // levels are compressed on the fly with Fast quality
+    std::vector<unsigned char> livePixels((size_t) imageSize * imageSize * 4);
+    Image liveImage{livePixels.data(), imageSize, imageSize, 4};
+    std::vector<MipLevel> liveLevels(mip_level_count(imageSize, imageSize) - 1);
+    PboRing ring;
+
+    // which texture (and array layer) each quad shows, swapping images only swaps table entries
+    MaterialTable materials(3);
+    GLuint liveTexture = 0;
+    if (layers) {
+        materials.set(2, layers->texture(), layers->reserve());
     } else {
-        std::cout << "Failed to load texture2" << std::endl;
+        glGenTextures(1, &liveTexture);
+        gl_state.bind_texture(0, GL_TEXTURE_2D, liveTexture);
+        glTexStorage2D(GL_TEXTURE_2D, (GLsizei) liveLevels.size() + 1, GL_RGBA8, imageSize, imageSize);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        materials.set(2, liveTexture);
     }
-//    stbi_image_free(data2);
 
     // render loop
     // -----------
     std::time_t prev_time = 0;
+    double lastTime = glfwGetTime(), frameStart = lastTime, worstFrame = 0;
+    int nbFrames = 0;
     while (!glfwWindowShouldClose(window)) {
+        // frame time trace, stalls show up as the worst frame of the second
+        double currentTime = glfwGetTime();
+        worstFrame = std::max(worstFrame, currentTime - frameStart);
+        frameStart = currentTime;
+        nbFrames++;
+        if (currentTime - lastTime >= 1.0) {
+            printf("%f fps, worst frame %f ms, %d ring stalls, %d direct uploads, %d GL calls issued, %d skipped last "
+                   "frame\n", double(nbFrames), worstFrame * 1000, ring.stalls, ring.direct, gl_state.last_issued,
+                   gl_state.last_saved);
+            nbFrames = 0;
+            worstFrame = 0;
+            lastTime += 1.0;
+        }
+
+        uploader.poll([&](const UploadResult &result) {
+            if (!result.texture) {
+                std::cout << "Failed to load texture " << result.id << std::endl;
+                return;
+            }
+            materials.set(result.id, result.texture, result.layer);
+            // another context wrote the layer, its texels are only guaranteed to show once the array is bound again
+            if (result.array) gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, 0);
+        });
+
         std::time_t curr_time = std::time(nullptr);
         if (curr_time != prev_time) {
-            if (curr_time % 2 == 0) {
-                glBindTexture(GL_TEXTURE_2D, texture);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
-                glBindTexture(GL_TEXTURE_2D, texture2);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data2);
+            materials.swap(0, 1);
+            prev_time = curr_time;
+        }
+
+        // moving rings, written into the ring and uploaded from there while earlier frames still draw
+        int shift = (int) (currentTime * 60);
+        for (int y = 0; y < imageSize; y++) {
+            for (int x = 0; x < imageSize; x++) {
+                int dx = x - imageSize / 2, dy = y - imageSize / 2;
+                auto v = (unsigned char) ((dx * dx + dy * dy) / 64 - shift);
+                unsigned char *p = &livePixels[((size_t) y * imageSize + x) * 4];
+                p[0] = v;
+                p[1] = (unsigned char) (x ^ y);
+                p[2] = (unsigned char) (255 - v);
+                p[3] = 255;
+            }
+        }
+        Image level = liveImage;
+        for (int l = 0; l <= (int) liveLevels.size(); l++) {
+            if (l > 0) {
+                liveLevels[l - 1] = mip_halve(level);
+                level = liveLevels[l - 1].image();
+            }
+            if (layers && compress) {
+                CompressedImage blocks = compress_image(level, BcQuality::Fast, bc7);
+                stream_compressed_layer(ring, layers->texture(), materials.layer(2), blocks.format, blocks.width,
+                                        blocks.height, blocks.data.data(), blocks.data.size(), l);
+            } else if (layers) {
+                stream_image_layer(ring, layers->texture(), materials.layer(2), level, l);
             } else {
-                glBindTexture(GL_TEXTURE_2D, texture);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data2);
-                glBindTexture(GL_TEXTURE_2D, texture2);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+                stream_image(ring, liveTexture, level, l);
             }
-            prev_time = curr_time;
         }
+        ring.fence();
 
         // render
         // ------
-        glUseProgram(shaderProgram);
-        glBindVertexArray(VAO);
-
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-
-        glBindTexture(GL_TEXTURE_2D, texture2);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void *) (6 * sizeof(float)));
+        shaders.update();
+        batch.clear();
+        // slot 0 and 1 swap every second, a slot without texture has nothing to sample yet
+        for (int slot = 0; slot < 3; slot++) {
+            if (!materials.get(slot)) continue;
+            float x0 = -0.8f + 0.2f * (float) slot;
+            // bindless instances pick the slot's handle, array instances the slot's layer
+            auto layer = (float) (bindless ? slot : materials.layer(slot));
+            batch.add({{x0, 0.8f, x0 + 0.2f, 0.6f}, {0, 0, 1, 1}, layer, {255, 255, 255, 255}});
+        }
+        if (bindless) {
+            handles.update(materials);
+            batch.draw_bindless(handles);
+        } else {
+            batch.draw(layers->texture());
+        }
+        gl_state.end_frame();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -221,9 +205,19 @@ int main() {
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    uploader.stop();
+    batch.release();
+    shaders.release();
+    handles.release();
+    ring.release();
+    if (layers) {
+        layers->release();
+    } else {
+        for (GLuint texture: materials.textures) {
+            glDeleteTextures(1, &texture);
+            gl_state.forget_texture(texture);
+        }
+    }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "bvh.h"
+#include "gl_state.h"
+#include "program_cache.h"
+#include "program_reflection.h"
+#include "vecmath.h"
+
+/**
+ * GPU-driven drawing: every object is a draw record in a buffer, a compute shader culls the records against the
+ * frustum and writes one DrawElementsIndirectCommand per object (instanceCount 0 when culled), and the whole set
+ * goes out in a single glMultiDrawElementsIndirect. CPU cost per frame is one dispatch and one draw call no matter
+ * how many objects there are, plus copying the objects that moved.
+ *
+ * Models and bounds live in persistently mapped buffers with one region per frame in flight, fenced after the draw
+ * like UniformRing, so the CPU never writes what the GPU may still be reading. Each region remembers which objects
+ * it is missing and only those are copied into it, scattered wherever they are.
+ *
+ * Each command's baseInstance is its object id. attach() adds a per-instance attribute that reads an identity
+ * buffer, so the vertex shader gets the id as an ordinary `in uint` without GL_ARB_shader_draw_parameters and
+ * looks up its model matrix in the Models buffer (std430 mat4 array, binding IndirectModelsBinding).
+ * Needs compute shaders, multi draw indirect and SSBOs (GL 4.3) and GL_ARB_buffer_storage.
+ * */
+
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// std430 layout of one culling record, w unused
+struct IndirectBounds {
+    float min[4];
+    float max[4];
+};
+
+enum IndirectBinding : GLuint {
+    IndirectBoundsBinding = 0,
+    IndirectRecordsBinding = 1,
+    IndirectCommandsBinding = 2,
+    IndirectModelsBinding = 3,
+};
+
+class IndirectScene {
+public:
+    static bool supported() {
+        return GLEW_ARB_compute_shader && GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object &&
+               GLEW_ARB_buffer_storage;
+    }
+
+    // only construct when supported(), the culling shader needs GL 4.3
+    IndirectScene() {
+        const char *computeShaderSource = R"###(
+                #version 430 core
+                layout (local_size_x = 64) in;
+                struct Draw {
+                    uint count;
+                    uint instanceCount;
+                    uint firstIndex;
+                    int baseVertex;
+                    uint baseInstance;
+                };
+                layout (std430, binding = 0) readonly buffer Bounds {
+                    vec4 bounds[]; // min, max per object
+                };
+                layout (std430, binding = 1) readonly buffer Records {
+                    Draw records[];
+                };
+                layout (std430, binding = 2) writeonly buffer Commands {
+                    Draw commands[];
+                };
+                uniform vec4 planes[6];
+                uniform uint objectCount;
+
+                void main() {
+                    uint i = gl_GlobalInvocationID.x;
+                    if (i >= objectCount) return;
+                    vec3 lo = bounds[i * 2u].xyz, hi = bounds[i * 2u + 1u].xyz;
+                    bool visible = true;
+                    for (int p = 0; p < 6; p++) {
+                        // the corner farthest along the plane normal
+                        vec3 far = mix(lo, hi, greaterThan(planes[p].xyz, vec3(0.0)));
+                        if (dot(planes[p].xyz, far) + planes[p].w < 0.0) visible = false;
+                    }
+                    Draw draw = records[i];
+                    draw.instanceCount = visible ? 1u : 0u;
+                    draw.baseInstance = i;
+                    commands[i] = draw;
+                }
+        )###";
+        program = create_program_cached({{GL_COMPUTE_SHADER, computeShaderSource}});
+        uniforms.reflect(program);
+        planesSlot = uniforms.slot("planes");
+        countSlot = uniforms.slot("objectCount");
+        GLuint buffers[3];
+        glGenBuffers(3, buffers);
+        recordsBuffer = buffers[0];
+        commandsBuffer = buffers[1];
+        idsBuffer = buffers[2];
+        GLint align = 256;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+        alignment = (size_t) std::max(align, 1);
+    }
+
+    IndirectScene(const IndirectScene &) = delete;
+
+    IndirectScene &operator=(const IndirectScene &) = delete;
+
+    ~IndirectScene() {
+        release();
+    }
+
+    // free the GL objects while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        if (program) {
+            glDeleteProgram(program);
+            gl_state.forget_program(program);
+        }
+        program = 0;
+        for (auto &fence: fences) {
+            if (fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+        unmap(modelsBuffer);
+        unmap(boundsBuffer);
+        if (recordsBuffer) {
+            GLuint buffers[5] = {boundsBuffer, recordsBuffer, commandsBuffer, modelsBuffer, idsBuffer};
+            glDeleteBuffers(5, buffers);
+            for (GLuint buffer: buffers) gl_state.forget_buffer(buffer);
+        }
+        boundsBuffer = recordsBuffer = commandsBuffer = modelsBuffer = idsBuffer = 0;
+        modelsMapping = boundsMapping = nullptr;
+    }
+
+    bool valid() const {
+        return program != 0;
+    }
+
+    size_t size() const {
+        return records.size();
+    }
+
+    // draw = which indices of the bound VAO make up the object, instanceCount and baseInstance are filled in
+    uint32_t add(const DrawElementsIndirectCommand &draw, const mat4 &model, const Aabb &box) {
+        records.push_back(draw);
+        models.push_back(model);
+        bounds.push_back({{box.min.x, box.min.y, box.min.z, 0}, {box.max.x, box.max.y, box.max.z, 0}});
+        missing.push_back(0);
+        recordsDirty = true;
+        auto id = (uint32_t) records.size() - 1;
+        mark(id);
+        return id;
+    }
+
+    void update(uint32_t id, const mat4 &model, const Aabb &box) {
+        models[id] = model;
+        bounds[id] = {{box.min.x, box.min.y, box.min.z, 0}, {box.max.x, box.max.y, box.max.z, 0}};
+        mark(id);
+    }
+
+    // per-instance object id at `location` of vao, the vao's other attributes are left alone
+    void attach(GLuint vao, GLuint location) {
+        gl_state.bind_vertex_array(vao);
+        gl_state.bind_buffer(GL_ARRAY_BUFFER, idsBuffer);
+        glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, 0, nullptr);
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+        gl_state.bind_vertex_array(0);
+    }
+
+    // move to the next frame's region, copy what it misses and write this frame's commands. Waits only if the GPU
+    // still reads the region from frames - 1 frames ago; false when waiting failed, draw() then skips this frame
+    bool cull(const mat4 &viewProjection) {
+        culled = false;
+        if (!program || records.empty()) return false;
+        frame = (frame + 1) % frames;
+        if (fences[frame]) {
+            GLenum status;
+            do status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+            while (status == GL_TIMEOUT_EXPIRED);
+            if (status == GL_WAIT_FAILED) {
+                std::cout << "Waiting for an indirect draw fence failed" << std::endl;
+                return false;
+            }
+            glDeleteSync(fences[frame]);
+            fences[frame] = nullptr;
+        }
+        upload();
+
+        Frustum frustum = frustum_from(viewProjection);
+        vec4 planes[6];
+        for (int p = 0; p < 6; p++) planes[p] = {frustum.x[p], frustum.y[p], frustum.z[p], frustum.w[p]};
+        gl_state.use_program(program);
+        // the count only goes out when objects were added, the planes when the camera moved
+        uniforms.set(planesSlot, planes, 6);
+        uniforms.set(countSlot, (GLuint) records.size());
+        gl_state.bind_buffer_range(GL_SHADER_STORAGE_BUFFER, IndirectBoundsBinding, boundsBuffer,
+                                   (GLintptr) (frame * boundsRegion),
+                                   (GLsizeiptr) (records.size() * sizeof(IndirectBounds)));
+        gl_state.bind_buffer_base(GL_SHADER_STORAGE_BUFFER, IndirectRecordsBinding, recordsBuffer);
+        gl_state.bind_buffer_base(GL_SHADER_STORAGE_BUFFER, IndirectCommandsBinding, commandsBuffer);
+        glDispatchCompute((GLuint) (records.size() + 63) / 64, 1, 1);
+        // the commands are read as indirect draw parameters next
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+        culled = true;
+        return true;
+    }
+
+    // one call for all objects after this frame's cull(), with the drawing program and VAO bound
+    void draw(GLenum indexType) {
+        if (!culled) return;
+        gl_state.bind_buffer_range(GL_SHADER_STORAGE_BUFFER, IndirectModelsBinding, modelsBuffer,
+                                   (GLintptr) (frame * modelsRegion), (GLsizeiptr) (records.size() * sizeof(mat4)));
+        gl_state.bind_buffer(GL_DRAW_INDIRECT_BUFFER, commandsBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, nullptr, (GLsizei) records.size(), 0);
+        // the region is free again once this draw (and the cull before it) is done
+        if (fences[frame]) glDeleteSync(fences[frame]);
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    static constexpr int frames = 3;
+
+    GLuint program = 0;
+    ProgramReflection uniforms;
+    int planesSlot = -1, countSlot = -1;
+    bool culled = false; // this frame's region holds commands from the last cull()
+    GLuint boundsBuffer = 0, recordsBuffer = 0, commandsBuffer = 0, modelsBuffer = 0, idsBuffer = 0;
+    std::vector<DrawElementsIndirectCommand> records;
+    std::vector<mat4> models;
+    std::vector<IndirectBounds> bounds;
+    size_t allocated = 0;
+    bool recordsDirty = false;
+    // ring of frames regions in the models and bounds buffers, each capacity objects long
+    size_t alignment = 256;
+    size_t capacity = 0, modelsRegion = 0, boundsRegion = 0;
+    unsigned char *modelsMapping = nullptr, *boundsMapping = nullptr;
+    int frame = 0;
+    GLsync fences[frames] = {};
+    // per object a bit for each region that misses its latest model and bounds, and per region the objects it misses
+    std::vector<uint8_t> missing;
+    std::vector<uint32_t> stale[frames];
+
+    void mark(uint32_t id) {
+        for (int f = 0; f < frames; f++) {
+            if (missing[id] & (1u << f)) continue;
+            missing[id] |= (uint8_t) (1u << f);
+            stale[f].push_back(id);
+        }
+    }
+
+    template<typename T>
+    static void buffer_data(GLuint buffer, const std::vector<T> &data) {
+        gl_state.bind_buffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) (data.size() * sizeof(T)), data.data(), GL_DYNAMIC_DRAW);
+    }
+
+    static void unmap(GLuint buffer) {
+        if (!buffer) return;
+        gl_state.bind_buffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+
+    // immutable storage can not grow: a new buffer for frames regions of region bytes, persistently mapped
+    static unsigned char *map_ring(GLuint &buffer, size_t region) {
+        GLuint old = buffer;
+        glGenBuffers(1, &buffer);
+        gl_state.bind_buffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) (region * frames), nullptr, flags);
+        auto *mapping = (unsigned char *) glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr) (region * frames),
+                                                           flags);
+        if (old) {
+            unmap(old);
+            glDeleteBuffers(1, &old);
+            gl_state.forget_buffer(old);
+        }
+        return mapping;
+    }
+
+    // regions for at least count objects, every region then misses every object
+    void reserve(size_t count) {
+        capacity = std::max(count, capacity * 2);
+        modelsRegion = (capacity * sizeof(mat4) + alignment - 1) / alignment * alignment;
+        boundsRegion = (capacity * sizeof(IndirectBounds) + alignment - 1) / alignment * alignment;
+        modelsMapping = map_ring(modelsBuffer, modelsRegion);
+        boundsMapping = map_ring(boundsBuffer, boundsRegion);
+        for (auto &ids: stale) ids.clear();
+        std::fill(missing.begin(), missing.end(), 0);
+        for (uint32_t id = 0; id < (uint32_t) records.size(); id++) mark(id);
+    }
+
+    void upload() {
+        if (records.size() > capacity) reserve(records.size());
+        if (records.size() != allocated) {
+            // new objects: the commands are GPU-written only, ids and records only change here
+            gl_state.bind_buffer(GL_SHADER_STORAGE_BUFFER, commandsBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) (records.size() * sizeof(DrawElementsIndirectCommand)),
+                         nullptr, GL_DYNAMIC_COPY);
+            std::vector<GLuint> ids(records.size());
+            for (size_t i = 0; i < ids.size(); i++) ids[i] = (GLuint) i;
+            gl_state.bind_buffer(GL_ARRAY_BUFFER, idsBuffer);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (ids.size() * sizeof(GLuint)), ids.data(), GL_STATIC_DRAW);
+            allocated = records.size();
+        }
+        // a fresh data store each time, a draw still reading the old one keeps it
+        if (recordsDirty) buffer_data(recordsBuffer, records);
+        recordsDirty = false;
+
+        // coherent mapping, the copies are visible to the cull and draw that follow
+        unsigned char *modelsOut = modelsMapping + frame * modelsRegion;
+        unsigned char *boundsOut = boundsMapping + frame * boundsRegion;
+        for (uint32_t id: stale[frame]) {
+            std::memcpy(modelsOut + id * sizeof(mat4), &models[id], sizeof(mat4));
+            std::memcpy(boundsOut + id * sizeof(IndirectBounds), &bounds[id], sizeof(IndirectBounds));
+            missing[id] &= (uint8_t) ~(1u << frame);
+        }
+        stale[frame].clear();
+    }
+};
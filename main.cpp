@@ -1,3 +1,7 @@
 //#include "img.cpp"
 //#include "color.cpp"
+//#include "mipbench.cpp"
+//#include "batch.cpp"
+//#include "mathbench.cpp"
+//#include "meshbench.cpp"
 #include "color2.cpp"
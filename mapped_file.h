@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only view of a whole file, mmap'ed where available (read into memory on windows)
+struct MappedFile {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(data, other.data);
+            std::swap(size, other.size);
+#ifdef _WIN32
+            std::swap(buffer, other.buffer);
+#endif
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const char *path) {
+        close();
+#ifdef _WIN32
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return false;
+        buffer.resize((size_t) in.tellg());
+        in.seekg(0);
+        if (!in.read((char *) buffer.data(), (std::streamsize) buffer.size())) return false;
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void *mapping = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) return false;
+        data = (const unsigned char *) mapping;
+        size = (size_t) st.st_size;
+        // the whole file is going to be read front to back
+        madvise(mapping, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        buffer.clear();
+#else
+        if (data) munmap((void *) data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+#ifdef _WIN32
+private:
+    std::vector<unsigned char> buffer;
+#endif
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <utility>
+#include <vector>
+
+#include "gl_state.h"
+
+/**
+ * Indirection from draw slots to textures.
+ *
+ * Draws look up their texture through the table, so changing what a slot shows (swapping, slideshows, A/B
+ * switching) rewrites an entry on the CPU and never uploads a texel again.
+ * */
+
+struct MaterialTable {
+    std::vector<GLuint> textures;
+    std::vector<int> layers; // layer of the slot's texture when that is an array texture, 0 otherwise
+
+    explicit MaterialTable(size_t slots = 0) : textures(slots, 0), layers(slots, 0) {}
+
+    void set(int slot, GLuint texture, int layer = 0) {
+        textures[slot] = texture;
+        layers[slot] = layer;
+    }
+
+    GLuint get(int slot) const {
+        return textures[slot];
+    }
+
+    int layer(int slot) const {
+        return layers[slot];
+    }
+
+    void swap(int a, int b) {
+        std::swap(textures[a], textures[b]);
+        std::swap(layers[a], layers[b]);
+    }
+
+    // bind the texture of slot to unit, nothing goes out when it is already there
+    void bind(int slot, GLuint unit = 0) const {
+        gl_state.bind_texture(unit, GL_TEXTURE_2D, textures[slot]);
+    }
+};
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+#include "vecmath.h"
+
+/**
+ * Microbenchmarks for vecmath.h, no window needed.
+ * */
+
+// keeps the optimizer from dropping the benchmarked work
+volatile float sink;
+
+// prints the time per operation, one call of f does `per_call` operations
+template<typename F>
+void bench(const char *name, int iterations, F f, size_t per_call = 1) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) f(i);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%-28s %8.2f ns\n", name, ns / iterations / (double) per_call);
+}
+
+int main() {
+#ifdef VECMATH_SSE
+    printf("vecmath: SSE\n");
+#else
+    printf("vecmath: scalar\n");
+#endif
+    const int iterations = 1000000;
+    mat4 a = perspective(45.0f, 1.0f, 0.1f, 100.0f);
+    mat4 b = look_at({4, 3, -4}, {0, 0, 0}, {0, 1, 0});
+
+    bench("mat4 * mat4", iterations, [&](int i) {
+        b.m[12] = (float) i;
+        sink = (a * b).m[0];
+    });
+    bench("mat4 * vec4", iterations, [&](int i) {
+        sink = (a * vec4{(float) i, 1, 2, 1}).x;
+    });
+    bench("inverse", iterations, [&](int i) {
+        b.m[12] = (float) i;
+        sink = inverse(b).m[0];
+    });
+    bench("perspective", iterations, [&](int i) {
+        sink = perspective(45.0f + (float) (i & 7), 1.0f, 0.1f, 100.0f).m[0];
+    });
+    bench("look_at", iterations, [&](int i) {
+        sink = look_at({4, 3, (float) i}, {0, 0, 0}, {0, 1, 0}).m[0];
+    });
+    quat q = angle_axis(0.1f, {0, 1, 0}), r = angle_axis(1.3f, {1, 1, 0});
+    bench("quat slerp + to_mat4", iterations, [&](int i) {
+        sink = to_mat4(slerp(q, r, (float) (i & 1023) / 1024)).m[0];
+    });
+
+    // batched, per element
+    std::vector<vec4> points(1 << 16, vec4{1, 2, 3, 1});
+    bench("transform (per vec4)", 100, [&](int) {
+        transform(a, points.data(), points.data(), points.size());
+        sink = points[0].x;
+    }, points.size());
+    std::vector<mat4> models(1 << 14, b), out(models.size());
+    bench("multiply (per mat4)", 100, [&](int) {
+        multiply(a, models.data(), out.data(), models.size());
+        sink = out[0].m[0];
+    }, models.size());
+    return 0;
+}
@@ -0,0 +1,751 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gl_state.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "vertex_format.h"
+
+/**
+ * OBJ and binary glTF (.glb) mesh loading straight into GL buffers.
+ *
+ * The file is memory mapped. OBJ is split into line-aligned chunks that are counted and then parsed in parallel,
+ * each chunk writing into its precomputed slice of the attribute arrays. glb accessors are read in place from the
+ * mapping. Vertices and indices are written by all threads directly into mapped GL buffers, there is no client-side
+ * copy of the final vertex or index data. Indices are 16 bit whenever the vertex count allows it.
+ *
+ * Vertex layout (MeshVertex): float position at location 0, snorm16 normal at 1, half float uv at 2.
+ * Needs the context current on the calling thread, the parsing threads never call GL.
+ * */
+
+struct MeshVertex {
+    float position[3];
+    int16_t normal[4];
+    uint16_t uv[2]; // half floats, uvs may tile outside [0, 1]
+};
+
+inline VertexFormat mesh_vertex_format() {
+    VertexFormat format;
+    format.add(0, 3, VertexType::Float).add(1, 4, VertexType::Snorm16).add(2, 2, VertexType::Half);
+    return format;
+}
+
+inline void write_mesh_vertex(void *out, const float *position, const float *normal, const float *uv) {
+    static const float zero[3] = {0, 0, 0};
+    MeshVertex vertex{};
+    std::memcpy(vertex.position, position, sizeof(vertex.position));
+    if (!normal) normal = zero;
+    if (!uv) uv = zero;
+    for (int k = 0; k < 3; k++) quantize_component(normal[k], VertexType::Snorm16, (unsigned char *) &vertex.normal[k]);
+    for (int k = 0; k < 2; k++) vertex.uv[k] = float_to_half(uv[k]);
+    // one whole-vertex store, the mapping is usually write-combined memory
+    std::memcpy(out, &vertex, sizeof(vertex));
+}
+
+struct Mesh {
+    GLuint vao = 0, vertex_buffer = 0, index_buffer = 0;
+    GLenum index_type = GL_UNSIGNED_SHORT;
+    size_t vertex_count = 0, index_count = 0;
+    float min[3] = {0, 0, 0}, max[3] = {0, 0, 0};
+
+    void draw() const {
+        gl_state.bind_vertex_array(vao);
+        glDrawElements(GL_TRIANGLES, (GLsizei) index_count, index_type, nullptr);
+    }
+
+    void release() {
+        if (vao) {
+            glDeleteVertexArrays(1, &vao);
+            gl_state.forget_vertex_array(vao);
+        }
+        if (vertex_buffer) {
+            glDeleteBuffers(1, &vertex_buffer);
+            gl_state.forget_buffer(vertex_buffer);
+        }
+        if (index_buffer) glDeleteBuffers(1, &index_buffer);
+        vao = vertex_buffer = index_buffer = 0;
+    }
+};
+
+// sizes the mesh's buffers and maps them for writing, the previous contents are discarded. On failure whatever was
+// mapped is still mapped (the other pointer is null), unmap_mesh_buffers() takes care of it
+inline bool map_mesh_buffers(Mesh &mesh, size_t vertex_count, size_t index_count, void *&vertices, void *&indices) {
+    mesh.release();
+    mesh.vertex_count = vertex_count;
+    mesh.index_count = index_count;
+    mesh.index_type = vertex_count < 0xffff ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    auto vertex_bytes = (GLsizeiptr) (vertex_count * sizeof(MeshVertex));
+    auto index_bytes = (GLsizeiptr) (index_count * index_size(mesh.index_type));
+
+    glGenVertexArrays(1, &mesh.vao);
+    gl_state.bind_vertex_array(mesh.vao);
+    glGenBuffers(1, &mesh.vertex_buffer);
+    gl_state.bind_buffer(GL_ARRAY_BUFFER, mesh.vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertex_bytes, nullptr, GL_STATIC_DRAW);
+    mesh_vertex_format().apply();
+    glGenBuffers(1, &mesh.index_buffer);
+    gl_state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mesh.index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, nullptr, GL_STATIC_DRAW);
+
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    vertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_bytes, access);
+    indices = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, index_bytes, access);
+    return vertices && indices;
+}
+
+// unmaps what map_mesh_buffers mapped, pass its pointers. The mesh's VAO (which holds the index buffer binding) and
+// vertex buffer stay bound
+inline bool unmap_mesh_buffers(Mesh &mesh, const void *vertices, const void *indices) {
+    gl_state.bind_vertex_array(mesh.vao);
+    gl_state.bind_buffer(GL_ARRAY_BUFFER, mesh.vertex_buffer);
+    // false means the driver lost the contents (e.g. display mode change), the data has to be written again
+    bool ok = !vertices || glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    ok = (!indices || glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE) && ok;
+    return ok;
+}
+
+inline void write_mesh_index(void *indices, GLenum type, size_t i, uint32_t value) {
+    if (type == GL_UNSIGNED_SHORT) ((uint16_t *) indices)[i] = (uint16_t) value;
+    else ((uint32_t *) indices)[i] = value;
+}
+
+// ---- OBJ ----
+
+namespace obj_detail {
+    inline bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char *skip_space(const char *p, const char *end) {
+        while (p < end && is_space(*p)) p++;
+        return p;
+    }
+
+    inline const char *next_line(const char *p, const char *end) {
+        while (p < end && *p != '\n') p++;
+        return p < end ? p + 1 : end;
+    }
+
+    // plain decimal / exponent float parsing, locale independent and much faster than strtof
+    inline const char *parse_float(const char *p, const char *end, float &out) {
+        p = skip_space(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+        double value = 0;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+        if (p < end && *p == '.') {
+            p++;
+            double scale = 0.1;
+            while (p < end && *p >= '0' && *p <= '9') {
+                value += (*p++ - '0') * scale;
+                scale *= 0.1;
+            }
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negative_exponent = false;
+            if (p < end && (*p == '-' || *p == '+')) negative_exponent = *p++ == '-';
+            int exponent = 0;
+            while (p < end && *p >= '0' && *p <= '9') exponent = exponent * 10 + (*p++ - '0');
+            double power = 1, base = 10;
+            for (; exponent; exponent >>= 1, base *= base)
+                if (exponent & 1) power *= base;
+            value = negative_exponent ? value / power : value * power;
+        }
+        out = (float) (negative ? -value : value);
+        return p;
+    }
+
+    inline const char *parse_int(const char *p, const char *end, long &out) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+        long value = 0;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // what a chunk holds, and after the prefix sum where its output starts
+    struct Counts {
+        size_t positions = 0, uvs = 0, normals = 0, triangles = 0;
+    };
+
+    // one face corner, 0-based attribute indices, -1 when absent
+    struct Corner {
+        int32_t position, uv, normal;
+    };
+
+    inline int face_corner_count(const char *p, const char *end) {
+        int corners = 0;
+        while (true) {
+            p = skip_space(p, end);
+            if (p >= end || *p == '\n' || *p == '#') return corners;
+            corners++;
+            while (p < end && !is_space(*p) && *p != '\n') p++;
+        }
+    }
+
+    inline Counts count_chunk(const char *p, const char *end) {
+        Counts counts;
+        while (p < end) {
+            p = skip_space(p, end);
+            if (end - p > 1 && p[0] == 'v' && is_space(p[1])) counts.positions++;
+            else if (end - p > 2 && p[0] == 'v' && p[1] == 't' && is_space(p[2])) counts.uvs++;
+            else if (end - p > 2 && p[0] == 'v' && p[1] == 'n' && is_space(p[2])) counts.normals++;
+            else if (end - p > 1 && p[0] == 'f' && is_space(p[1]))
+                counts.triangles += (size_t) std::max(0, face_corner_count(p + 1, end) - 2);
+            p = next_line(p, end);
+        }
+        return counts;
+    }
+
+    // OBJ indices are 1-based, negative ones count back from the attributes read so far
+    inline int32_t resolve(long index, size_t seen) {
+        if (index > 0) return (int32_t) (index - 1);
+        if (index < 0) return (int32_t) ((long) seen + index);
+        return -1;
+    }
+
+    inline void parse_chunk(const char *p, const char *end, Counts at, float *positions, float *uvs, float *normals,
+                            Corner *corners) {
+        while (p < end) {
+            p = skip_space(p, end);
+            if (end - p > 1 && p[0] == 'v' && is_space(p[1])) {
+                p++;
+                for (int k = 0; k < 3; k++) p = parse_float(p, end, positions[at.positions * 3 + k]);
+                at.positions++;
+            } else if (end - p > 2 && p[0] == 'v' && p[1] == 't' && is_space(p[2])) {
+                p += 2;
+                for (int k = 0; k < 2; k++) p = parse_float(p, end, uvs[at.uvs * 2 + k]);
+                at.uvs++;
+            } else if (end - p > 2 && p[0] == 'v' && p[1] == 'n' && is_space(p[2])) {
+                p += 2;
+                for (int k = 0; k < 3; k++) p = parse_float(p, end, normals[at.normals * 3 + k]);
+                at.normals++;
+            } else if (end - p > 1 && p[0] == 'f' && is_space(p[1])) {
+                p++;
+                // triangle fan over the polygon
+                Corner first{}, previous{};
+                int n = 0;
+                while (true) {
+                    p = skip_space(p, end);
+                    if (p >= end || *p == '\n' || *p == '#') break;
+                    long v = 0, t = 0, normal = 0;
+                    p = parse_int(p, end, v);
+                    if (p < end && *p == '/') {
+                        p++;
+                        if (p < end && *p != '/') p = parse_int(p, end, t);
+                        if (p < end && *p == '/') p = parse_int(p + 1, end, normal);
+                    }
+                    while (p < end && !is_space(*p) && *p != '\n') p++;
+                    Corner corner{resolve(v, at.positions), resolve(t, at.uvs), resolve(normal, at.normals)};
+                    if (n == 0) first = corner;
+                    else if (n >= 2) {
+                        Corner *out = &corners[at.triangles++ * 3];
+                        out[0] = first;
+                        out[1] = previous;
+                        out[2] = corner;
+                    }
+                    previous = corner;
+                    n++;
+                }
+            }
+            p = next_line(p, end);
+        }
+    }
+}
+
+inline bool load_obj(const MappedFile &file, Mesh &mesh) {
+    using namespace obj_detail;
+    const char *begin = (const char *) file.data, *end = begin + file.size;
+
+    // line aligned chunks, a few per thread so uneven chunks balance out
+    int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(threads * 4, file.size >> 16));
+    std::vector<const char *> starts(chunk_count + 1);
+    starts[0] = begin;
+    starts[chunk_count] = end;
+    for (size_t c = 1; c < chunk_count; c++) {
+        const char *p = begin + file.size * c / chunk_count;
+        starts[c] = std::max(starts[c - 1], next_line(p - 1, end));
+    }
+
+    std::vector<Counts> counts(chunk_count + 1);
+    parallel_for(0, (int) chunk_count, [&](int b, int e) {
+        for (int c = b; c < e; c++) counts[c + 1] = count_chunk(starts[c], starts[c + 1]);
+    });
+    // exclusive prefix sum: counts[c] is where chunk c writes, counts[chunk_count] the totals
+    for (size_t c = 1; c <= chunk_count; c++) {
+        counts[c].positions += counts[c - 1].positions;
+        counts[c].uvs += counts[c - 1].uvs;
+        counts[c].normals += counts[c - 1].normals;
+        counts[c].triangles += counts[c - 1].triangles;
+    }
+    Counts total = counts[chunk_count];
+    if (!total.positions || !total.triangles) return false;
+
+    std::vector<float> positions(total.positions * 3), uvs(total.uvs * 2), normals(total.normals * 3);
+    std::vector<Corner> corners(total.triangles * 3);
+    parallel_for(0, (int) chunk_count, [&](int b, int e) {
+        for (int c = b; c < e; c++)
+            parse_chunk(starts[c], starts[c + 1], counts[c], positions.data(), uvs.data(), normals.data(),
+                        corners.data());
+    });
+
+    // a corner is valid when its indices are in range; when every uv / normal index equals the position index the
+    // position indices can be used as is, otherwise corners are deduplicated into vertices
+    bool valid = true, shared = true;
+    for (const Corner &corner: corners) {
+        valid = valid && corner.position >= 0 && (size_t) corner.position < total.positions &&
+                corner.uv < (int32_t) total.uvs && corner.normal < (int32_t) total.normals;
+        shared = shared && (corner.uv < 0 || corner.uv == corner.position) &&
+                 (corner.normal < 0 || corner.normal == corner.position);
+    }
+    if (!valid) return false;
+
+    // vertex_corner[v]: a corner that defines vertex v, corner_vertex[i]: vertex of corner i
+    std::vector<uint32_t> vertex_corner, corner_vertex;
+    size_t vertex_count = total.positions;
+    if (!shared) {
+        // open addressing table over (position, uv, normal)
+        size_t capacity = 1;
+        while (capacity < corners.size() * 2) capacity <<= 1;
+        std::vector<uint32_t> table(capacity, UINT32_MAX);
+        corner_vertex.resize(corners.size());
+        for (size_t i = 0; i < corners.size(); i++) {
+            const Corner &corner = corners[i];
+            uint64_t hash = (uint64_t) (uint32_t) corner.position * 0x9E3779B97F4A7C15ull ^
+                            (uint64_t) (uint32_t) corner.uv * 0xC2B2AE3D27D4EB4Full ^
+                            (uint64_t) (uint32_t) corner.normal * 0x165667B19E3779F9ull;
+            size_t slot = (size_t) (hash >> 20) & (capacity - 1);
+            while (true) {
+                uint32_t v = table[slot];
+                if (v == UINT32_MAX) {
+                    table[slot] = (uint32_t) vertex_corner.size();
+                    corner_vertex[i] = (uint32_t) vertex_corner.size();
+                    vertex_corner.push_back((uint32_t) i);
+                    break;
+                }
+                const Corner &other = corners[vertex_corner[v]];
+                if (other.position == corner.position && other.uv == corner.uv && other.normal == corner.normal) {
+                    corner_vertex[i] = v;
+                    break;
+                }
+                slot = (slot + 1) & (capacity - 1);
+            }
+        }
+        vertex_count = vertex_corner.size();
+    } else if (total.uvs || total.normals) {
+        // attributes come from any corner that uses the position, a positions-only vertex keeps zeros
+        vertex_corner.assign(vertex_count, UINT32_MAX);
+        for (size_t i = 0; i < corners.size(); i++) vertex_corner[corners[i].position] = (uint32_t) i;
+    }
+
+    void *vertices, *indices;
+    if (!map_mesh_buffers(mesh, vertex_count, corners.size(), vertices, indices)) {
+        unmap_mesh_buffers(mesh, vertices, indices);
+        mesh.release();
+        return false;
+    }
+    GLenum index_type = mesh.index_type;
+    parallel_for(0, (int) vertex_count, [&](int b, int e) {
+        for (int v = b; v < e; v++) {
+            const Corner *corner = vertex_corner.empty() || vertex_corner[v] == UINT32_MAX ? nullptr
+                                                                                          : &corners[vertex_corner[v]];
+            size_t p = corner ? (size_t) corner->position : (size_t) v;
+            const float *uv = corner && corner->uv >= 0 ? &uvs[corner->uv * 2] : nullptr;
+            const float *normal = corner && corner->normal >= 0 ? &normals[corner->normal * 3] : nullptr;
+            write_mesh_vertex((MeshVertex *) vertices + v, &positions[p * 3], normal, uv);
+        }
+    }, 4096);
+    parallel_for(0, (int) corners.size(), [&](int b, int e) {
+        for (int i = b; i < e; i++)
+            write_mesh_index(indices, index_type, i,
+                             corner_vertex.empty() ? (uint32_t) corners[i].position : corner_vertex[i]);
+    }, 4096);
+
+    for (int k = 0; k < 3; k++) mesh.min[k] = mesh.max[k] = positions[k];
+    for (size_t p = 0; p < total.positions; p++) {
+        for (int k = 0; k < 3; k++) {
+            mesh.min[k] = std::min(mesh.min[k], positions[p * 3 + k]);
+            mesh.max[k] = std::max(mesh.max[k], positions[p * 3 + k]);
+        }
+    }
+    return unmap_mesh_buffers(mesh, vertices, indices);
+}
+
+// ---- glb ----
+
+// just enough JSON for the glTF header, numbers as doubles
+struct JsonValue {
+    enum Type {Null, Bool, Number, String, Array, Object} type = Null;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    const JsonValue *get(const char *key) const {
+        for (const auto &member: object)
+            if (member.first == key) return &member.second;
+        return nullptr;
+    }
+
+    const JsonValue *at(size_t i) const {
+        return i < array.size() ? &array[i] : nullptr;
+    }
+
+    double number_or(const char *key, double fallback) const {
+        const JsonValue *value = get(key);
+        return value && value->type == Number ? value->number : fallback;
+    }
+
+    // the value as an index, count or byte size, false unless it is a whole number that fits a size_t exactly
+    bool size(size_t &out) const {
+        if (type != Number || !(number >= 0) || number != std::floor(number) || number > 9007199254740992.0 ||
+            number > (double) std::numeric_limits<size_t>::max())
+            return false;
+        out = (size_t) number;
+        return true;
+    }
+
+    // member key as a size, fallback when it is missing; false when it is there but not a size
+    bool size_or(const char *key, size_t fallback, size_t &out) const {
+        const JsonValue *value = get(key);
+        if (!value) {
+            out = fallback;
+            return true;
+        }
+        return value->size(out);
+    }
+};
+
+namespace json_detail {
+    inline void skip(const char *&p, const char *end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+
+    inline bool parse_string(const char *&p, const char *end, std::string &out) {
+        if (p >= end || *p != '"') return false;
+        p++;
+        while (p < end && *p != '"') {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+                // escapes are kept as their letter, glTF keys and the values read here are plain ASCII
+                switch (*p) {
+                    case 'n':
+                        out += '\n';
+                        break;
+                    case 't':
+                        out += '\t';
+                        break;
+                    case 'u':
+                        p += std::min<ptrdiff_t>(4, end - p - 1);
+                        out += '?';
+                        break;
+                    default:
+                        out += *p;
+                }
+                p++;
+            } else {
+                out += *p++;
+            }
+        }
+        if (p >= end) return false;
+        p++;
+        return true;
+    }
+
+    inline bool parse_value(const char *&p, const char *end, JsonValue &out, int depth = 0) {
+        skip(p, end);
+        if (p >= end || depth > 64) return false;
+        if (*p == '{') {
+            out.type = JsonValue::Object;
+            p++;
+            skip(p, end);
+            if (p < end && *p == '}') return ++p, true;
+            while (true) {
+                std::string key;
+                skip(p, end);
+                if (!parse_string(p, end, key)) return false;
+                skip(p, end);
+                if (p >= end || *p++ != ':') return false;
+                out.object.emplace_back(std::move(key), JsonValue());
+                if (!parse_value(p, end, out.object.back().second, depth + 1)) return false;
+                skip(p, end);
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                return p < end && *p++ == '}';
+            }
+        }
+        if (*p == '[') {
+            out.type = JsonValue::Array;
+            p++;
+            skip(p, end);
+            if (p < end && *p == ']') return ++p, true;
+            while (true) {
+                out.array.emplace_back();
+                if (!parse_value(p, end, out.array.back(), depth + 1)) return false;
+                skip(p, end);
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                return p < end && *p++ == ']';
+            }
+        }
+        if (*p == '"') {
+            out.type = JsonValue::String;
+            return parse_string(p, end, out.string);
+        }
+        if (end - p >= 4 && std::memcmp(p, "true", 4) == 0) {
+            out.type = JsonValue::Bool;
+            out.number = 1;
+            p += 4;
+            return true;
+        }
+        if (end - p >= 5 && std::memcmp(p, "false", 5) == 0) {
+            out.type = JsonValue::Bool;
+            p += 5;
+            return true;
+        }
+        if (end - p >= 4 && std::memcmp(p, "null", 4) == 0) {
+            p += 4;
+            return true;
+        }
+        // full double precision, byte offsets and lengths above 2^24 have to stay exact
+        out.type = JsonValue::Number;
+        std::from_chars_result result = std::from_chars(p, end, out.number);
+        if (result.ec != std::errc()) return false;
+        p = result.ptr;
+        return true;
+    }
+}
+
+inline bool parse_json(const char *begin, const char *end, JsonValue &out) {
+    return json_detail::parse_value(begin, end, out);
+}
+
+// a glTF accessor resolved to a pointer into the mapped BIN chunk
+struct GltfAccessor {
+    const unsigned char *data = nullptr;
+    size_t count = 0, stride = 0;
+    int component_type = 0, components = 0;
+    bool normalized = false;
+
+    // component k of element i as float, normalized integers map to [0, 1] / [-1, 1]
+    float read(size_t i, int k) const {
+        const unsigned char *p = data + i * stride;
+        switch (component_type) {
+            case 5126: { // GL_FLOAT
+                float v;
+                std::memcpy(&v, p + k * 4, 4);
+                return v;
+            }
+            case 5121:
+                return normalized ? p[k] / 255.0f : (float) p[k];
+            case 5120:
+                return normalized ? std::max(-1.0f, (int8_t) p[k] / 127.0f) : (float) (int8_t) p[k];
+            case 5123: {
+                uint16_t v;
+                std::memcpy(&v, p + k * 2, 2);
+                return normalized ? v / 65535.0f : (float) v;
+            }
+            case 5122: {
+                int16_t v;
+                std::memcpy(&v, p + k * 2, 2);
+                return normalized ? std::max(-1.0f, v / 32767.0f) : (float) v;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    uint32_t index(size_t i) const {
+        const unsigned char *p = data + i * stride;
+        if (component_type == 5121) return *p;
+        if (component_type == 5123) {
+            uint16_t v;
+            std::memcpy(&v, p, 2);
+            return v;
+        }
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+};
+
+inline bool gltf_accessor(const JsonValue &gltf, const unsigned char *bin, size_t bin_size, size_t index,
+                          GltfAccessor &out) {
+    const JsonValue *accessors = gltf.get("accessors"), *views = gltf.get("bufferViews");
+    const JsonValue *accessor = accessors ? accessors->at(index) : nullptr;
+    if (!accessor || !views || accessor->get("sparse")) return false;
+    const JsonValue *view_index = accessor->get("bufferView");
+    size_t view_slot;
+    if (!view_index || !view_index->size(view_slot)) return false;
+    const JsonValue *view = views->at(view_slot);
+    if (!view || view->number_or("buffer", 0) != 0) return false;
+
+    const JsonValue *type = accessor->get("type");
+    if (!type) return false;
+    static const std::pair<const char *, int> types[] = {{"SCALAR", 1}, {"VEC2", 2}, {"VEC3", 3}, {"VEC4", 4}};
+    for (const auto &t: types)
+        if (type->string == t.first) out.components = t.second;
+    size_t component_type;
+    if (!accessor->size_or("componentType", 0, component_type) || component_type < 5120 || component_type > 5126)
+        return false;
+    out.component_type = (int) component_type;
+    int component_size = out.component_type == 5126 || out.component_type == 5125 ? 4
+                         : out.component_type == 5122 || out.component_type == 5123 ? 2 : 1;
+    const JsonValue *normalized = accessor->get("normalized");
+    out.normalized = normalized && normalized->number != 0;
+    size_t view_offset, view_length, accessor_offset;
+    if (!accessor->size_or("count", 0, out.count) || !view->size_or("byteStride", 0, out.stride) ||
+        !view->size_or("byteOffset", 0, view_offset) || !view->size_or("byteLength", 0, view_length) ||
+        !accessor->size_or("byteOffset", 0, accessor_offset) || !out.components)
+        return false;
+    auto element = (size_t) (component_size * out.components);
+    if (!out.stride) out.stride = element;
+
+    // the view has to lie in the chunk and the last element in the view, compared so that nothing can wrap around
+    if (view_offset > bin_size || view_length > bin_size - view_offset || accessor_offset > view_length) return false;
+    size_t room = view_length - accessor_offset;
+    if (out.count && (element > room || (out.count > 1 && out.stride > (room - element) / (out.count - 1))))
+        return false;
+    out.data = bin + view_offset + accessor_offset;
+    return true;
+}
+
+// every triangle primitive of every mesh, concatenated; node transforms are not applied
+inline bool load_glb(const MappedFile &file, Mesh &mesh) {
+    const unsigned char *p = file.data;
+    auto read32 = [](const unsigned char *at) {
+        uint32_t v;
+        std::memcpy(&v, at, 4);
+        return v;
+    };
+    if (file.size < 20 || read32(p) != 0x46546C67 || read32(p + 4) != 2) return false; // "glTF", version 2
+    size_t json_size = read32(p + 12);
+    if (read32(p + 16) != 0x4E4F534A || 20 + json_size > file.size) return false; // "JSON"
+    const unsigned char *bin = nullptr;
+    size_t bin_size = 0, bin_header = 20 + json_size;
+    if (bin_header + 8 <= file.size && read32(p + bin_header + 4) == 0x004E4942) { // "BIN"
+        bin_size = std::min<size_t>(read32(p + bin_header), file.size - bin_header - 8);
+        bin = p + bin_header + 8;
+    }
+
+    JsonValue gltf;
+    if (!parse_json((const char *) p + 20, (const char *) p + 20 + json_size, gltf)) return false;
+    const JsonValue *meshes = gltf.get("meshes");
+    if (!meshes) return false;
+
+    struct Part {
+        GltfAccessor position, normal, uv, indices;
+        bool has_normal = false, has_uv = false, has_indices = false;
+        size_t first_vertex = 0, first_index = 0;
+    };
+    std::vector<Part> parts;
+    size_t vertex_count = 0, index_count = 0;
+    for (const JsonValue &gltf_mesh: meshes->array) {
+        const JsonValue *primitives = gltf_mesh.get("primitives");
+        if (!primitives) continue;
+        for (const JsonValue &primitive: primitives->array) {
+            const JsonValue *attributes = primitive.get("attributes");
+            const JsonValue *position = attributes ? attributes->get("POSITION") : nullptr;
+            if (primitive.number_or("mode", 4) != 4 || !position) continue;
+            Part part;
+            size_t accessor;
+            if (!position->size(accessor) || !gltf_accessor(gltf, bin, bin_size, accessor, part.position) ||
+                part.position.components != 3)
+                return false;
+            if (const JsonValue *normal = attributes->get("NORMAL"))
+                part.has_normal = normal->size(accessor) && gltf_accessor(gltf, bin, bin_size, accessor, part.normal);
+            if (const JsonValue *uv = attributes->get("TEXCOORD_0"))
+                part.has_uv = uv->size(accessor) && gltf_accessor(gltf, bin, bin_size, accessor, part.uv);
+            if (const JsonValue *indices = primitive.get("indices")) {
+                if (!indices->size(accessor) || !gltf_accessor(gltf, bin, bin_size, accessor, part.indices))
+                    return false;
+                part.has_indices = true;
+            }
+            part.first_vertex = vertex_count;
+            part.first_index = index_count;
+            vertex_count += part.position.count;
+            index_count += part.has_indices ? part.indices.count : part.position.count;
+            parts.push_back(part);
+        }
+    }
+    if (!vertex_count || !index_count) return false;
+
+    void *vertices, *indices;
+    if (!map_mesh_buffers(mesh, vertex_count, index_count, vertices, indices)) {
+        unmap_mesh_buffers(mesh, vertices, indices);
+        mesh.release();
+        return false;
+    }
+    GLenum index_type = mesh.index_type;
+    for (const Part &part: parts) {
+        parallel_for(0, (int) part.position.count, [&](int b, int e) {
+            float position[3], normal[3] = {0, 0, 0}, uv[2] = {0, 0};
+            for (int v = b; v < e; v++) {
+                for (int k = 0; k < 3; k++) position[k] = part.position.read(v, k);
+                if (part.has_normal)
+                    for (int k = 0; k < 3; k++) normal[k] = part.normal.read(v, k);
+                if (part.has_uv)
+                    for (int k = 0; k < 2; k++) uv[k] = part.uv.read(v, k);
+                write_mesh_vertex((MeshVertex *) vertices + part.first_vertex + v, position, normal, uv);
+            }
+        }, 4096);
+        size_t count = part.has_indices ? part.indices.count : part.position.count;
+        parallel_for(0, (int) count, [&](int b, int e) {
+            for (int i = b; i < e; i++) {
+                uint32_t index = part.has_indices ? part.indices.index(i) : (uint32_t) i;
+                if (index >= part.position.count) index = 0; // out of range indices would read past the buffer
+                write_mesh_index(indices, index_type, part.first_index + i, (uint32_t) part.first_vertex + index);
+            }
+        }, 4096);
+
+        // POSITION has min / max in the accessor by spec, but not every exporter writes it
+        for (size_t v = 0; v < part.position.count; v++) {
+            for (int k = 0; k < 3; k++) {
+                float x = part.position.read(v, k);
+                if (v == 0 && &part == &parts[0]) mesh.min[k] = mesh.max[k] = x;
+                mesh.min[k] = std::min(mesh.min[k], x);
+                mesh.max[k] = std::max(mesh.max[k], x);
+            }
+        }
+    }
+    return unmap_mesh_buffers(mesh, vertices, indices);
+}
+
+// .glb or .obj by extension
+inline bool load_mesh(const char *path, Mesh &mesh) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cout << "Failed to open mesh " << path << std::endl;
+        return false;
+    }
+    std::string name(path);
+    std::string extension = name.substr(name.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) {
+        return (char) std::tolower((unsigned char) c);
+    });
+    bool ok = extension == "glb" ? load_glb(file, mesh) : extension == "obj" && load_obj(file, mesh);
+    if (!ok) std::cout << "Failed to load mesh " << path << std::endl;
+    return ok;
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+/**
+ * Triangle and vertex reordering for indexed triangle lists, at load time or offline.
+ *
+ * optimize_vertex_cache: Forsyth's linear-speed vertex cache optimisation, triangles that reuse recently
+ *   transformed vertices go first.
+ * optimize_overdraw: Tipsify-style clustering, the cache-ordered list is cut where the cache starts cold anyway and
+ *   the clusters are sorted so outward facing, outer ones draw first. Gives up clusters until the ACMR stays within
+ *   `threshold` of the cache-optimised order.
+ * optimize_vertex_fetch: renumbers vertices in first-use order so vertex fetch walks the buffer forward.
+ * analyze_vertex_cache: ACMR (transformed vertices per triangle, 0.5 is ideal on a big grid, 3 is the worst) and
+ *   ATVR (transformed vertices per vertex, 1 is ideal) of a FIFO post-transform cache.
+ *
+ * Works on 16 or 32 bit index arrays in place, positions are floats read with a byte stride.
+ * */
+
+struct MeshCacheStats {
+    float acmr;
+    float atvr;
+};
+
+template<typename T>
+MeshCacheStats analyze_vertex_cache(const T *indices, size_t count, size_t vertex_count, unsigned cache_size = 16) {
+    // vertex v is in the FIFO cache while fewer than cache_size other vertices were transformed after it
+    std::vector<uint32_t> stamp(vertex_count, 0);
+    uint32_t transformed = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        T v = indices[i];
+        if (!stamp[v]) used++;
+        if (!stamp[v] || transformed + 1 - stamp[v] > cache_size) stamp[v] = ++transformed;
+    }
+    return {count ? (float) transformed / (float) (count / 3) : 0, used ? (float) transformed / (float) used : 0};
+}
+
+namespace mesh_optimize_detail {
+    constexpr int cache_size = 32;
+
+    // Forsyth's vertex score: recent cache entries score high, the last triangle's vertices a bit less
+    // (so strips do not degenerate), vertices with few triangles left get a boost so they are finished off
+    inline float vertex_score(int cache_position, uint32_t live_triangles) {
+        if (!live_triangles) return -1.0f;
+        float score = 0;
+        if (cache_position >= 0) {
+            if (cache_position < 3) score = 0.75f;
+            else score = std::pow(1.0f - (float) (cache_position - 3) / (cache_size - 3), 1.5f);
+        }
+        return score + 2.0f / std::sqrt((float) live_triangles);
+    }
+}
+
+template<typename T>
+void optimize_vertex_cache(T *indices, size_t count, size_t vertex_count) {
+    using namespace mesh_optimize_detail;
+    size_t triangle_count = count / 3;
+    if (!triangle_count) return;
+
+    // triangles of every vertex, packed; the first live[v] entries are the ones not emitted yet
+    std::vector<uint32_t> live(vertex_count, 0), offsets(vertex_count + 1, 0);
+    for (size_t i = 0; i < count; i++) live[indices[i]]++;
+    for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+    std::vector<uint32_t> adjacency(count), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < count; i++) adjacency[fill[indices[i]]++] = (uint32_t) (i / 3);
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) score[v] = vertex_score(-1, live[v]);
+    std::vector<float> triangle_score(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++)
+        triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    std::vector<char> emitted(triangle_count, 0);
+
+    std::vector<T> out;
+    out.reserve(count);
+    std::vector<uint32_t> cache, next_cache;
+    cache.reserve(cache_size + 3);
+    next_cache.reserve(cache_size + 3);
+
+    long best = (long) (std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin());
+    size_t cursor = 0;
+    for (size_t n = 0; n < triangle_count; n++) {
+        if (best < 0) {
+            // nothing in the cache touches a live triangle: start over at the next one in input order
+            while (emitted[cursor]) cursor++;
+            best = (long) cursor;
+        }
+        auto t = (size_t) best;
+        emitted[t] = 1;
+        const T *tri = &indices[t * 3];
+        out.insert(out.end(), tri, tri + 3);
+
+        // drop the triangle from its vertices' live lists
+        for (int k = 0; k < 3; k++) {
+            T v = tri[k];
+            uint32_t *list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < live[v]; j++) {
+                if (list[j] == t) {
+                    std::swap(list[j], list[live[v] - 1]);
+                    break;
+                }
+            }
+            live[v]--;
+        }
+
+        // the triangle's vertices move to the front of the LRU cache
+        next_cache.assign(tri, tri + 3);
+        for (uint32_t v: cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.push_back(v);
+        std::swap(cache, next_cache);
+
+        // rescore everything that was or still is in the cache, then the triangles they touch
+        for (size_t i = 0; i < cache.size(); i++) {
+            uint32_t v = cache[i];
+            cache_position[v] = i < (size_t) cache_size ? (int) i : -1;
+            score[v] = vertex_score(cache_position[v], live[v]);
+        }
+        best = -1;
+        float best_score = -1;
+        for (uint32_t v: cache) {
+            for (uint32_t j = 0; j < live[v]; j++) {
+                uint32_t u = adjacency[offsets[v] + j];
+                const T *other = &indices[u * 3];
+                float s = score[other[0]] + score[other[1]] + score[other[2]];
+                triangle_score[u] = s;
+                if (s > best_score) {
+                    best_score = s;
+                    best = u;
+                }
+            }
+        }
+        if (cache.size() > (size_t) cache_size) cache.resize(cache_size);
+    }
+    std::copy(out.begin(), out.end(), indices);
+}
+
+template<typename T>
+void optimize_overdraw(T *indices, size_t count, const float *positions, size_t position_stride, size_t vertex_count,
+                       float threshold = 1.05f) {
+    size_t triangle_count = count / 3;
+    if (triangle_count < 2) return;
+    auto position = [&](T v) {
+        return (const float *) ((const unsigned char *) positions + (size_t) v * position_stride);
+    };
+
+    // hard boundaries: triangles whose three vertices all miss the FIFO cache
+    std::vector<size_t> boundaries;
+    {
+        std::vector<uint32_t> stamp(vertex_count, 0);
+        uint32_t transformed = 0;
+        const unsigned fifo = 16;
+        for (size_t t = 0; t < triangle_count; t++) {
+            int misses = 0;
+            for (int k = 0; k < 3; k++) {
+                T v = indices[t * 3 + k];
+                if (!stamp[v] || transformed + 1 - stamp[v] > fifo) {
+                    stamp[v] = ++transformed;
+                    misses++;
+                }
+            }
+            if (misses == 3) boundaries.push_back(t);
+        }
+        if (boundaries.empty() || boundaries[0] != 0) boundaries.insert(boundaries.begin(), 0);
+    }
+
+    // mesh centroid
+    double centroid[3] = {0, 0, 0};
+    for (size_t i = 0; i < count; i++)
+        for (int k = 0; k < 3; k++) centroid[k] += position(indices[i])[k];
+    for (double &c: centroid) c /= (double) count;
+
+    float base_acmr = analyze_vertex_cache(indices, count, vertex_count).acmr;
+    std::vector<T> sorted(count);
+    // fewer, larger clusters each round until the cache cost is acceptable
+    for (size_t min_size = 1;; min_size *= 2) {
+        std::vector<size_t> starts;
+        for (size_t b: boundaries)
+            if (starts.empty() || b - starts.back() >= min_size) starts.push_back(b);
+        if (starts.size() < 2) return;
+        starts.push_back(triangle_count);
+
+        // occlusion potential: how far the cluster sits out along its own (area weighted) normal
+        size_t cluster_count = starts.size() - 1;
+        std::vector<float> potential(cluster_count);
+        for (size_t c = 0; c < cluster_count; c++) {
+            double center[3] = {0, 0, 0}, normal[3] = {0, 0, 0}, area = 0;
+            for (size_t t = starts[c]; t < starts[c + 1]; t++) {
+                const float *p0 = position(indices[t * 3]), *p1 = position(indices[t * 3 + 1]),
+                        *p2 = position(indices[t * 3 + 2]);
+                double e1[3], e2[3];
+                for (int k = 0; k < 3; k++) {
+                    e1[k] = p1[k] - p0[k];
+                    e2[k] = p2[k] - p0[k];
+                }
+                double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                               e1[0] * e2[1] - e1[1] * e2[0]};
+                double a = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int k = 0; k < 3; k++) {
+                    normal[k] += n[k];
+                    center[k] += (p0[k] + p1[k] + p2[k]) / 3 * a;
+                }
+                area += a;
+            }
+            double d = 0;
+            if (area > 0)
+                for (int k = 0; k < 3; k++) d += (center[k] / area - centroid[k]) * normal[k];
+            potential[c] = (float) d;
+        }
+
+        std::vector<size_t> order(cluster_count);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return potential[a] > potential[b];
+        });
+        size_t i = 0;
+        for (size_t c: order)
+            for (size_t t = starts[c]; t < starts[c + 1]; t++)
+                for (int k = 0; k < 3; k++) sorted[i++] = indices[t * 3 + k];
+
+        if (analyze_vertex_cache(sorted.data(), count, vertex_count).acmr <= base_acmr * threshold) {
+            std::copy(sorted.begin(), sorted.end(), indices);
+            return;
+        }
+    }
+}
+
+// returns the new vertex count, vertices no index refers to are dropped from the end
+template<typename T>
+size_t optimize_vertex_fetch(T *indices, size_t count, void *vertices, size_t vertex_size, size_t vertex_count) {
+    const auto unused = (uint32_t) -1;
+    std::vector<uint32_t> remap(vertex_count, unused);
+    uint32_t next = 0;
+    auto *data = (unsigned char *) vertices;
+    std::vector<unsigned char> reordered(vertex_count * vertex_size);
+    for (size_t i = 0; i < count; i++) {
+        T v = indices[i];
+        if (remap[v] == unused) {
+            remap[v] = next;
+            std::memcpy(&reordered[next * vertex_size], data + (size_t) v * vertex_size, vertex_size);
+            next++;
+        }
+        indices[i] = (T) remap[v];
+    }
+    std::memcpy(data, reordered.data(), next * vertex_size);
+    return next;
+}
+
+// all three passes, positions are 3 floats at position_offset inside each vertex; prints the cache stats
+template<typename T>
+size_t optimize_mesh(T *indices, size_t count, void *vertices, size_t vertex_size, size_t vertex_count,
+                     size_t position_offset = 0) {
+    MeshCacheStats before = analyze_vertex_cache(indices, count, vertex_count);
+    optimize_vertex_cache(indices, count, vertex_count);
+    optimize_overdraw(indices, count, (const float *) ((unsigned char *) vertices + position_offset), vertex_size,
+                      vertex_count);
+    size_t used = optimize_vertex_fetch(indices, count, vertices, vertex_size, vertex_count);
+    MeshCacheStats after = analyze_vertex_cache(indices, count, used);
+    std::cout << count / 3 << " triangles: ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+    return used;
+}
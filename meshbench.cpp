@@ -0,0 +1,115 @@
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "primitives.h"
+#include "mesh_optimize.h"
+#include "mesh_loader.h"
+
+/**
+ * Mesh optimizer check on generated meshes, no window needed. Triangle order is shuffled first, the way an
+ * exporter that does not care about caches would leave it.
+ *
+ * Then mesh loading into GL buffers is timed in a hidden window: the mesh given on the command line, or a generated
+ * 1M triangle OBJ grid with positions, uvs and normals (written to the temp directory once).
+ * */
+
+template<size_t V, size_t I>
+void optimize(const char *name, const Primitive<V, I> &primitive) {
+    std::vector<PrimitiveVertex> vertices(primitive.vertices.begin(), primitive.vertices.end());
+    std::vector<uint16_t> indices(primitive.indices.begin(), primitive.indices.end());
+
+    MeshCacheStats generated = analyze_vertex_cache(indices.data(), indices.size(), vertices.size());
+    std::vector<size_t> triangles(indices.size() / 3);
+    for (size_t t = 0; t < triangles.size(); t++) triangles[t] = t;
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1));
+    std::vector<uint16_t> shuffled;
+    for (size_t t: triangles) shuffled.insert(shuffled.end(), &indices[t * 3], &indices[t * 3 + 3]);
+
+    printf("%s, generated order: ACMR %.3f, ATVR %.3f\n", name, generated.acmr, generated.atvr);
+    printf("%s, shuffled: ", name);
+    auto start = std::chrono::steady_clock::now();
+    optimize_mesh(shuffled.data(), shuffled.size(), vertices.data(), sizeof(PrimitiveVertex), vertices.size(),
+                  offsetof(PrimitiveVertex, position));
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%s, optimized in %.2f ms\n", name, ms);
+}
+
+// (size + 1)^2 vertices and 2 * size^2 triangles, every corner indexes v/vt/vn alike
+std::string write_grid_obj(int size) {
+    std::string path = (std::filesystem::temp_directory_path() / ("meshbench_grid" + std::to_string(size) + ".obj"))
+            .string();
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec)) return path;
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) return {};
+    for (int z = 0; z <= size; z++) {
+        for (int x = 0; x <= size; x++) {
+            float u = (float) x / (float) size, v = (float) z / (float) size;
+            fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0.000000 1.000000 0.000000\n", u * 2 - 1,
+                    0.1f * std::sin(u * 20) * std::cos(v * 20), v * 2 - 1, u, v);
+        }
+    }
+    for (int z = 0; z < size; z++) {
+        for (int x = 0; x < size; x++) {
+            int a = z * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b,
+                    b, b, b, c, c, c, d, d, d);
+        }
+    }
+    fclose(file);
+    return path;
+}
+
+void time_load(const std::string &path) {
+    std::error_code ec;
+    double megabytes = (double) std::filesystem::file_size(path, ec) / (1 << 20);
+    Mesh mesh;
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    bool ok = load_mesh(path.c_str(), mesh);
+    glFinish();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (ok)
+        printf("%s: %.1f MB, %zu vertices, %zu triangles loaded in %.2f ms on %u threads\n", path.c_str(), megabytes,
+               mesh.vertex_count, mesh.index_count / 3, ms, std::thread::hardware_concurrency());
+    mesh.release();
+}
+
+int main(int argc, char **argv) {
+    optimize("cube", cube_primitive);
+    optimize("sphere 16x32", sphere_primitive);
+    // too big to be worth a constexpr table, built at runtime
+    static const auto grid = make_grid<128>();
+    optimize("grid 128", grid);
+
+    if (!glfwInit()) {
+        fprintf(stderr, "ERROR: could not start GLFW3\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "OpenGLPlayground", nullptr, nullptr);
+    if (!window) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+
+    glewExperimental = GL_TRUE;
+    glewInit();
+
+    std::string path = argc > 1 ? argv[1] : write_grid_obj(707);
+    if (!path.empty()) time_load(path);
+
+    glfwTerminate();
+    return 0;
+}
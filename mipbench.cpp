@@ -0,0 +1,90 @@
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+#include "mipmap.h"
+
+/**
+ * Compares the CPU mip chain generator and its compute shader fallback against glGenerateMipmap on large RGBA
+ * textures.
+ * */
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    if (!glfwInit()) {
+        fprintf(stderr, "ERROR: could not start GLFW3\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "OpenGLPlayground", nullptr, nullptr);
+    if (!window) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+
+    glewExperimental = GL_TRUE;
+    glewInit();
+
+    MipCompute compute;
+    for (int size: {1024, 2048, 4096}) {
+        // some structure so the filters have something to do
+        std::vector<unsigned char> pixels((size_t) size * size * 4);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                unsigned char *p = &pixels[((size_t) y * size + x) * 4];
+                p[0] = (unsigned char) (x ^ y);
+                p[1] = (unsigned char) ((x * 7) >> 3);
+                p[2] = (unsigned char) ((x / 8 + y / 8) % 2 * 255);
+                p[3] = 255;
+            }
+        }
+        Image image{pixels.data(), size, size, 4};
+
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        int levels = mip_level_count(size, size) - 1;
+
+        for (MipFilter filter: {MipFilter::Box, MipFilter::Kaiser}) {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<MipLevel> chain = generate_mip_chain(image, true, filter);
+            double generate = elapsed_ms(start);
+            upload_image(texture, image);
+            for (int level = 0; level < levels; level++) upload_image(texture, chain[level].image(), level + 1);
+            glFinish();
+            printf("%dx%d cpu %s: %.2f ms generate, %.2f ms including upload\n", size, size,
+                   filter == MipFilter::Box ? "box" : "kaiser", generate, elapsed_ms(start));
+        }
+
+        if (compute.supported()) {
+            glFinish();
+            auto start = std::chrono::steady_clock::now();
+            compute.generate(texture, image);
+            glFinish();
+            printf("%dx%d compute box: %.2f ms including upload\n", size, size, elapsed_ms(start));
+        }
+
+        upload_image(texture, image);
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        generate_mipmaps_driver(texture);
+        glFinish();
+        printf("%dx%d glGenerateMipmap: %.2f ms\n", size, size, elapsed_ms(start));
+
+        glDeleteTextures(1, &texture);
+    }
+
+    compute.release();
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "parallel.h"
+#include "shader.h"
+#include "texture.h"
+
+/**
+ * CPU mip chain generation.
+ *
+ * Level 0 is decoded once into linear light floats (colour channels through the sRGB curve, alpha as is),
+ * every following level is filtered from the previous float level so quantization error does not accumulate,
+ * and each level is encoded back to 8 bit on its own. Rows are filtered on all hardware threads.
+ *
+ * MipCompute is the GPU fallback for uncompressed textures when no worker can be spared: the same linear-light
+ * box filter as a compute shader, one dispatch per level reading the level above.
+ * */
+
+enum class MipFilter {
+    Box,    // 2x2 average
+    Kaiser, // separable 6 tap Kaiser windowed sinc, sharper minification
+};
+
+struct MipLevel {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<unsigned char> data;
+
+    Image image() const {
+        return {const_cast<unsigned char *>(data.data()), width, height, channels};
+    }
+};
+
+struct MipFloatLevel {
+    int width = 0;
+    int height = 0;
+    std::vector<float> data;
+};
+
+struct SrgbTables {
+    float to_linear[256];
+    unsigned char to_srgb[4096];
+
+    SrgbTables() {
+        for (int i = 0; i < 256; i++) {
+            float c = (float) i / 255.0f;
+            to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < 4096; i++) {
+            float l = (float) i / 4095.0f;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            to_srgb[i] = (unsigned char) std::clamp((int) (c * 255.0f + 0.5f), 0, 255);
+        }
+    }
+};
+
+inline const SrgbTables &srgb_tables() {
+    static const SrgbTables tables;
+    return tables;
+}
+
+// alpha is the last channel of 2 and 4 channel images and is always filtered linearly
+inline bool mip_is_alpha(int channel, int channels) {
+    return (channels == 2 || channels == 4) && channel == channels - 1;
+}
+
+inline MipFloatLevel mip_decode(const Image &image, bool srgb) {
+    const SrgbTables &tables = srgb_tables();
+    MipFloatLevel level{image.width, image.height, std::vector<float>((size_t) image.width * image.height * image.channels)};
+    int channels = image.channels;
+    parallel_for(0, image.height, [&](int begin, int end) {
+        for (size_t i = (size_t) begin * image.width * channels; i < (size_t) end * image.width * channels; i++) {
+            unsigned char v = image.data[i];
+            level.data[i] = srgb && !mip_is_alpha((int) (i % channels), channels) ? tables.to_linear[v] : v / 255.0f;
+        }
+    }, 16);
+    return level;
+}
+
+inline MipLevel mip_encode(const MipFloatLevel &level, int channels, bool srgb) {
+    const SrgbTables &tables = srgb_tables();
+    MipLevel result{level.width, level.height, channels, std::vector<unsigned char>(level.data.size())};
+    parallel_for(0, level.height, [&](int begin, int end) {
+        for (size_t i = (size_t) begin * level.width * channels; i < (size_t) end * level.width * channels; i++) {
+            float v = std::clamp(level.data[i], 0.0f, 1.0f);
+            result.data[i] = srgb && !mip_is_alpha((int) (i % channels), channels)
+                             ? tables.to_srgb[(int) (v * 4095.0f + 0.5f)]
+                             : (unsigned char) (v * 255.0f + 0.5f);
+        }
+    }, 16);
+    return result;
+}
+
+// 6 taps at source offsets -2.5 .. 2.5 around the destination texel centre, normalized
+inline const float *mip_kaiser_weights() {
+    static const std::vector<float> weights = [] {
+        auto bessel_i0 = [](float x) {
+            float sum = 1, term = 1;
+            for (int k = 1; k < 16; k++) {
+                term *= (x / (2 * (float) k)) * (x / (2 * (float) k));
+                sum += term;
+            }
+            return sum;
+        };
+        const float alpha = 4.0f, radius = 1.5f;
+        std::vector<float> w(6);
+        float total = 0;
+        for (int i = 0; i < 6; i++) {
+            float t = ((float) i - 2.5f) / 2.0f; // in destination texels
+            float sinc = t == 0 ? 1.0f : std::sin((float) M_PI * t) / ((float) M_PI * t);
+            float r = t / radius;
+            float window = bessel_i0(alpha * std::sqrt(std::max(0.0f, 1 - r * r))) / bessel_i0(alpha);
+            w[i] = sinc * window;
+            total += w[i];
+        }
+        for (float &v: w) v /= total;
+        return w;
+    }();
+    return weights.data();
+}
+
+inline MipFloatLevel mip_downsample(const MipFloatLevel &src, int channels, MipFilter filter) {
+    MipFloatLevel dst{std::max(1, src.width / 2), std::max(1, src.height / 2), {}};
+    dst.data.resize((size_t) dst.width * dst.height * channels);
+
+    if (filter == MipFilter::Box) {
+        parallel_for(0, dst.height, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                const float *row0 = &src.data[(size_t) std::min(2 * y, src.height - 1) * src.width * channels];
+                const float *row1 = &src.data[(size_t) std::min(2 * y + 1, src.height - 1) * src.width * channels];
+                float *out = &dst.data[(size_t) y * dst.width * channels];
+                for (int x = 0; x < dst.width; x++) {
+                    int x0 = std::min(2 * x, src.width - 1) * channels;
+                    int x1 = std::min(2 * x + 1, src.width - 1) * channels;
+                    for (int c = 0; c < channels; c++)
+                        out[x * channels + c] = 0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]);
+                }
+            }
+        }, 8);
+        return dst;
+    }
+
+    // separable: horizontal into a half width temporary, then vertical
+    const float *w = mip_kaiser_weights();
+    std::vector<float> temp((size_t) dst.width * src.height * channels);
+    parallel_for(0, src.height, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            const float *row = &src.data[(size_t) y * src.width * channels];
+            float *out = &temp[(size_t) y * dst.width * channels];
+            for (int x = 0; x < dst.width; x++) {
+                float sum[4] = {0, 0, 0, 0};
+                for (int t = 0; t < 6; t++) {
+                    int sx = std::clamp(2 * x - 2 + t, 0, src.width - 1) * channels;
+                    for (int c = 0; c < channels; c++) sum[c] += w[t] * row[sx + c];
+                }
+                for (int c = 0; c < channels; c++) out[x * channels + c] = sum[c];
+            }
+        }
+    }, 8);
+    int stride = dst.width * channels;
+    parallel_for(0, dst.height, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            float *out = &dst.data[(size_t) y * stride];
+            std::fill(out, out + stride, 0.0f);
+            for (int t = 0; t < 6; t++) {
+                const float *row = &temp[(size_t) std::clamp(2 * y - 2 + t, 0, src.height - 1) * stride];
+                for (int i = 0; i < stride; i++) out[i] += w[t] * row[i];
+            }
+        }
+    }, 8);
+    return dst;
+}
+
+inline int mip_level_count(int width, int height) {
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+// levels 1..n of image, built one after another on a worker thread. Each future becomes ready as soon as
+// its level is done, so the caller can upload level k while level k + 1 is still being filtered.
+// image.data has to stay alive until the last future is ready.
+inline std::vector<std::shared_future<MipLevel>>
+generate_mip_chain_async(const Image &image, bool srgb = true, MipFilter filter = MipFilter::Box) {
+    int count = mip_level_count(image.width, image.height) - 1;
+    auto promises = std::make_shared<std::vector<std::promise<MipLevel>>>(count);
+    std::vector<std::shared_future<MipLevel>> futures;
+    for (auto &promise: *promises) futures.push_back(promise.get_future().share());
+
+    std::thread([image, srgb, filter, promises] {
+        MipFloatLevel level = mip_decode(image, srgb);
+        for (auto &promise: *promises) {
+            level = mip_downsample(level, image.channels, filter);
+            promise.set_value(mip_encode(level, image.channels, srgb));
+        }
+    }).detach();
+    return futures;
+}
+
+inline std::vector<MipLevel> generate_mip_chain(const Image &image, bool srgb = true, MipFilter filter = MipFilter::Box) {
+    std::vector<MipLevel> levels;
+    for (auto &future: generate_mip_chain_async(image, srgb, filter)) levels.push_back(future.get());
+    return levels;
+}
+
+// the next level of image as the 2x2 average of its stored 8 bit values, on the calling thread. Not linear light,
+// but cheap enough for content that is regenerated every frame
+inline MipLevel mip_halve(const Image &image) {
+    MipLevel result{std::max(1, image.width / 2), std::max(1, image.height / 2), image.channels, {}};
+    result.data.resize((size_t) result.width * result.height * image.channels);
+    size_t stride = (size_t) image.width * image.channels;
+    for (int y = 0; y < result.height; y++) {
+        const unsigned char *row0 = image.data + std::min(2 * y, image.height - 1) * stride;
+        const unsigned char *row1 = image.data + std::min(2 * y + 1, image.height - 1) * stride;
+        for (int x = 0; x < result.width; x++) {
+            int x0 = std::min(2 * x, image.width - 1) * image.channels;
+            int x1 = std::min(2 * x + 1, image.width - 1) * image.channels;
+            unsigned char *out = &result.data[((size_t) y * result.width + x) * image.channels];
+            for (int c = 0; c < image.channels; c++)
+                out[c] = (unsigned char) ((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+        }
+    }
+    return result;
+}
+
+// trilinear filtering over level 0 .. levels
+inline void set_mip_filtering(GLuint texture, int levels) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
+
+class MipCompute {
+public:
+    // compute shaders with image stores, GL 4.3
+    static bool supported() {
+        return GLEW_ARB_compute_shader && GLEW_ARB_shader_image_load_store;
+    }
+
+    MipCompute() = default;
+
+    MipCompute(const MipCompute &) = delete;
+
+    MipCompute &operator=(const MipCompute &) = delete;
+
+    ~MipCompute() {
+        release();
+    }
+
+    // free the GL objects while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        for (GLuint &program: programs) {
+            if (program) glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    // upload image as level 0 of texture and filter levels 1..n from it with the box filter,
+    // false (and texture untouched) when the shader is not available
+    bool generate(GLuint texture, const Image &image, bool srgb = true) {
+        // RGB8 cannot be bound as an image, 3 channel images are stored as RGBA8 with alpha 1
+        GLenum internal = image.channels == 3 ? GL_RGBA8 : image_internal_format(image.channels);
+        GLuint program = get(internal);
+        if (!program) return false;
+
+        int levels = mip_level_count(image.width, image.height);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        // every level has to exist before the image stores, the texture is incomplete otherwise
+        for (int level = 0, width = image.width, height = image.height; level < levels; level++) {
+            glTexImage2D(GL_TEXTURE_2D, level, (GLint) internal, width, height, 0, image_format(image.channels),
+                         GL_UNSIGNED_BYTE, level == 0 ? image.data : nullptr);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        set_texture_swizzle(image.channels);
+        set_mip_filtering(texture, levels - 1);
+
+        glUseProgram(program);
+        glUniform1i(1, image.channels);
+        glUniform1i(2, srgb);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (int level = 1, width = image.width, height = image.height; level < levels; level++) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            glUniform1i(0, level - 1);
+            glBindImageTexture(0, texture, level, GL_FALSE, 0, GL_WRITE_ONLY, internal);
+            glDispatchCompute((GLuint) (width + 7) / 8, (GLuint) (height + 7) / 8, 1);
+            // the next dispatch samples what this one stored
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+        glUseProgram(0);
+        return true;
+    }
+
+private:
+    GLuint programs[3] = {0, 0, 0}; // r8, rg8, rgba8
+    bool failed[3] = {false, false, false};
+
+    GLuint get(GLenum internal) {
+        int slot = internal == GL_R8 ? 0 : internal == GL_RG8 ? 1 : 2;
+        if (programs[slot] || failed[slot]) return programs[slot];
+        static const char *formats[3] = {"r8", "rg8", "rgba8"};
+        // texelFetch sees the swizzled texel, 2 channel images come back as (v, v, v, a)
+        std::string source = std::string(R"###(
+#version 430
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D source;
+layout(binding = 0, )###") + formats[slot] + R"###() writeonly uniform image2D destination;
+layout(location = 0) uniform int sourceLevel;
+layout(location = 1) uniform int channels;
+layout(location = 2) uniform bool srgb;
+
+vec4 toLinear(vec4 c) {
+    return mix(c / 12.92, pow((c + 0.055) / 1.055, vec4(2.4)), greaterThan(c, vec4(0.04045)));
+}
+
+vec4 toSrgb(vec4 c) {
+    return mix(c * 12.92, 1.055 * pow(c, vec4(1.0 / 2.4)) - 0.055, greaterThan(c, vec4(0.0031308)));
+}
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(p, imageSize(destination)))) return;
+    ivec2 last = textureSize(source, sourceLevel) - 1;
+    // alpha stays linear
+    bvec4 curve = bvec4(srgb, srgb && channels > 2, srgb && channels > 2, false);
+    vec4 sum = vec4(0.0);
+    for (int i = 0; i < 4; i++) {
+        vec4 texel = texelFetch(source, min(2 * p + ivec2(i & 1, i >> 1), last), sourceLevel);
+        if (channels == 2) texel = vec4(texel.r, texel.a, 0.0, 1.0);
+        sum += mix(texel, toLinear(texel), curve);
+    }
+    sum *= 0.25;
+    imageStore(destination, p, mix(sum, toSrgb(clamp(sum, 0.0, 1.0)), curve));
+}
+)###";
+        programs[slot] = create_compute_program(source.c_str());
+        failed[slot] = !programs[slot];
+        return programs[slot];
+    }
+};
+
+// glGenerateMipmap, whatever filter the driver uses (usually a box filter on the sRGB-encoded values).
+// Level 0 has to be uploaded already; the last resort when neither worker nor compute shader is available,
+// and mipbench's baseline
+inline void generate_mipmaps_driver(GLuint texture) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
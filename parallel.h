@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// split [begin, end) into one contiguous chunk per hardware thread and run fn(chunk_begin, chunk_end) on each,
+// blocking until all chunks are done. Runs inline when the range is too small to be worth a thread.
+template<typename F>
+void parallel_for(int begin, int end, F fn, int min_chunk = 1) {
+    int count = end - begin;
+    if (count <= 0) return;
+    int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max(1, count / std::max(1, min_chunk)));
+    if (threads == 1) {
+        fn(begin, end);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    int chunk = (count + threads - 1) / threads;
+    for (int t = 1; t < threads; t++) {
+        int b = begin + t * chunk;
+        int e = std::min(end, b + chunk);
+        if (b < e) workers.emplace_back(fn, b, e);
+    }
+    fn(begin, std::min(end, begin + chunk));
+    for (auto &worker: workers) worker.join();
+}
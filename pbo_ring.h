@@ -0,0 +1,183 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstring>
+#include <deque>
+#include <iostream>
+
+#include "gl_state.h"
+#include "texture.h"
+
+/**
+ * Persistently mapped pixel unpack buffer ring for texture streaming.
+ *
+ * Texel data is memcpy'd into the mapped ring and glTexSubImage* sources it from a buffer offset, so the driver
+ * never copies client memory and the DMA overlaps with drawing. Every fence() closes the regions written since the
+ * previous one with a glFenceSync, and a region is only reused once its fence has signalled.
+ * Needs GL_ARB_buffer_storage, available() is false otherwise and callers should upload from client memory; the
+ * stream_* helpers do that themselves, also for uploads larger than the ring.
+ * */
+
+class PboRing {
+public:
+    explicit PboRing(size_t size = 16 << 20) : size(size) {
+        if (!GLEW_ARB_buffer_storage) return;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) size, nullptr, flags);
+        mapping = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) size, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    PboRing(const PboRing &) = delete;
+
+    PboRing &operator=(const PboRing &) = delete;
+
+    ~PboRing() {
+        release();
+    }
+
+    // free the GL objects while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        for (auto &region: in_flight) glDeleteSync(region.sync);
+        in_flight.clear();
+        if (buffer) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapping = nullptr;
+    }
+
+    bool available() const {
+        return mapping != nullptr;
+    }
+
+    GLuint name() const {
+        return buffer;
+    }
+
+    // reserve bytes in the ring, offset is the buffer offset and ptr where to write them. Only waits when the GPU
+    // still reads the region being wrapped onto; false when bytes does not fit into the ring or the wait failed
+    bool allocate(size_t bytes, size_t &offset, unsigned char *&ptr, size_t alignment = 16) {
+        if (!mapping || bytes > size) return false;
+        offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + bytes > size) {
+            // the region written since the last fence has to be closed before the ring wraps over it
+            if (head != open_begin) fence();
+            offset = 0;
+        }
+        if (!wait(offset, offset + bytes)) return false;
+        head = offset + bytes;
+        if (open_begin == open_end) open_begin = offset;
+        open_end = head;
+        ptr = mapping + offset;
+        return true;
+    }
+
+    // fence everything allocated since the last call, call it after the uploads that read it were issued
+    void fence() {
+        if (open_begin == open_end) return;
+        in_flight.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), open_begin, open_end});
+        open_begin = open_end = head;
+    }
+
+    // number of times allocate() had to block on the GPU, to spot a ring that is too small
+    int stalls = 0;
+    // uploads the stream_* helpers sent from client memory because the ring could not take them
+    int direct = 0;
+
+private:
+    struct Region {
+        GLsync sync;
+        size_t begin;
+        size_t end;
+    };
+
+    size_t size;
+    GLuint buffer = 0;
+    unsigned char *mapping = nullptr;
+    size_t head = 0;
+    size_t open_begin = 0;
+    size_t open_end = 0;
+    std::deque<Region> in_flight;
+
+    // retire fenced regions in order until none of them overlaps [begin, end). A region is only retired once its
+    // fence has signalled, false (nothing retired that is still read) when waiting failed
+    bool wait(size_t begin, size_t end) {
+        while (!in_flight.empty()) {
+            bool overlaps = false;
+            for (auto &region: in_flight) overlaps |= region.begin < end && begin < region.end;
+            Region &oldest = in_flight.front();
+            GLenum status = glClientWaitSync(oldest.sync, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                if (!overlaps) return true;
+                stalls++;
+                do status = glClientWaitSync(oldest.sync, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+                while (status == GL_TIMEOUT_EXPIRED);
+            }
+            if (status == GL_WAIT_FAILED) {
+                std::cout << "Waiting for a PBO ring fence failed" << std::endl;
+                return false;
+            }
+            glDeleteSync(oldest.sync);
+            in_flight.pop_front();
+        }
+        return true;
+    }
+};
+
+// where the texels of a stream_* upload come from: a ring offset, or client memory when the ring cannot take them
+inline const void *stream_source(PboRing &ring, const void *data, size_t bytes) {
+    size_t offset;
+    unsigned char *ptr;
+    if (!ring.allocate(bytes, offset, ptr)) {
+        ring.direct++;
+        return data;
+    }
+    std::memcpy(ptr, data, bytes);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.name());
+    return (const void *) offset;
+}
+
+// stream image into the existing storage of a level of texture through the ring
+inline void stream_image(PboRing &ring, GLuint texture, const Image &image, int level = 0) {
+    const void *source = stream_source(ring, image.data, (size_t) image.width * image.height * image.channels);
+    gl_state.bind_texture(0, GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, image.width, image.height, image_format(image.channels),
+                    GL_UNSIGNED_BYTE, source);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// same for a layer of an RGBA8 GL_TEXTURE_2D_ARRAY (a TextureArray), image has to be RGBA
+inline void stream_image_layer(PboRing &ring, GLuint array, int layer, const Image &image, int level = 0) {
+    const void *source = stream_source(ring, image.data, (size_t) image.width * image.height * 4);
+    gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, array);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                    source);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+inline void stream_compressed(PboRing &ring, GLuint texture, GLenum format, int width, int height,
+                              const unsigned char *data, size_t bytes, int level = 0) {
+    const void *source = stream_source(ring, data, bytes);
+    gl_state.bind_texture(0, GL_TEXTURE_2D, texture);
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, (GLsizei) bytes, source);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// same for a layer of a compressed GL_TEXTURE_2D_ARRAY, format has to be the array's
+inline void stream_compressed_layer(PboRing &ring, GLuint array, int layer, GLenum format, int width, int height,
+                                    const unsigned char *data, size_t bytes, int level = 0) {
+    const void *source = stream_source(ring, data, bytes);
+    gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, array);
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format, (GLsizei) bytes,
+                              source);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
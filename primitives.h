@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Indexed primitive geometry generated at compile time.
+ *
+ * Every generator shares vertices between the triangles of a face (or the whole surface) and emits a 16 bit index
+ * buffer, the resulting tables are constexpr and end up in the binary's read-only data, nothing is built at startup.
+ * Counter-clockwise front faces, +y up, centred on the origin, spans [-1, 1].
+ * */
+
+struct PrimitiveVertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+template<size_t VertexCount, size_t IndexCount>
+struct Primitive {
+    static_assert(VertexCount <= 65536, "16 bit indices");
+    std::array<PrimitiveVertex, VertexCount> vertices{};
+    std::array<uint16_t, IndexCount> indices{};
+};
+
+// constexpr sin/cos (std:: ones are not constexpr in C++17), accurate to float precision
+constexpr double primitive_pi = 3.14159265358979323846;
+
+constexpr double primitive_sin(double x) {
+    // reduce to [-pi, pi]
+    while (x > primitive_pi) x -= 2 * primitive_pi;
+    while (x < -primitive_pi) x += 2 * primitive_pi;
+    double term = x, sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double primitive_cos(double x) {
+    return primitive_sin(x + primitive_pi / 2);
+}
+
+// 4 vertices per face so every face keeps its own normal and uv, 24 vertices / 36 indices
+constexpr Primitive<24, 36> make_cube() {
+    Primitive<24, 36> cube;
+    // normal, then the face's u and v axes (u x v = normal)
+    constexpr float faces[6][3][3] = {
+            {{1,  0,  0},  {0,  0, -1}, {0, 1, 0}},
+            {{-1, 0,  0},  {0,  0, 1},  {0, 1, 0}},
+            {{0,  1,  0},  {1,  0, 0},  {0, 0, -1}},
+            {{0,  -1, 0},  {1,  0, 0},  {0, 0, 1}},
+            {{0,  0,  1},  {1,  0, 0},  {0, 1, 0}},
+            {{0,  0,  -1}, {-1, 0, 0},  {0, 1, 0}},
+    };
+    constexpr float corners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    for (int face = 0; face < 6; face++) {
+        const auto &n = faces[face][0], &u = faces[face][1], &v = faces[face][2];
+        for (int corner = 0; corner < 4; corner++) {
+            float s = corners[corner][0] * 2 - 1, t = corners[corner][1] * 2 - 1;
+            PrimitiveVertex &vertex = cube.vertices[face * 4 + corner];
+            for (int k = 0; k < 3; k++) {
+                vertex.position[k] = n[k] + s * u[k] + t * v[k];
+                vertex.normal[k] = n[k];
+            }
+            vertex.uv[0] = corners[corner][0];
+            vertex.uv[1] = corners[corner][1];
+        }
+        constexpr uint16_t quad[6] = {0, 1, 2, 0, 2, 3};
+        for (int i = 0; i < 6; i++) cube.indices[face * 6 + i] = (uint16_t) (face * 4 + quad[i]);
+    }
+    return cube;
+}
+
+// N x N quads in the xz plane from -1 to 1, facing +y
+template<int N>
+constexpr Primitive<(N + 1) * (N + 1), N * N * 6> make_grid() {
+    Primitive<(N + 1) * (N + 1), N * N * 6> grid;
+    for (int z = 0; z <= N; z++) {
+        for (int x = 0; x <= N; x++) {
+            PrimitiveVertex &vertex = grid.vertices[z * (N + 1) + x];
+            vertex.position[0] = (float) x / N * 2 - 1;
+            vertex.position[1] = 0;
+            vertex.position[2] = (float) z / N * 2 - 1;
+            vertex.normal[1] = 1;
+            vertex.uv[0] = (float) x / N;
+            vertex.uv[1] = (float) z / N;
+        }
+    }
+    size_t i = 0;
+    for (int z = 0; z < N; z++) {
+        for (int x = 0; x < N; x++) {
+            auto a = (uint16_t) (z * (N + 1) + x), b = (uint16_t) (a + 1);
+            auto c = (uint16_t) (a + N + 1), d = (uint16_t) (c + 1);
+            // counter-clockwise seen from +y
+            grid.indices[i++] = a;
+            grid.indices[i++] = c;
+            grid.indices[i++] = b;
+            grid.indices[i++] = b;
+            grid.indices[i++] = c;
+            grid.indices[i++] = d;
+        }
+    }
+    return grid;
+}
+
+constexpr Primitive<4, 6> make_plane() {
+    return make_grid<1>();
+}
+
+// UV sphere of radius 1, the seam column and the pole rows are duplicated for their uvs
+template<int Stacks, int Slices>
+constexpr Primitive<(Stacks + 1) * (Slices + 1), Stacks * Slices * 6> make_sphere() {
+    Primitive<(Stacks + 1) * (Slices + 1), Stacks * Slices * 6> sphere;
+    for (int stack = 0; stack <= Stacks; stack++) {
+        double phi = primitive_pi * stack / Stacks; // 0 at the north pole
+        for (int slice = 0; slice <= Slices; slice++) {
+            double theta = 2 * primitive_pi * slice / Slices;
+            PrimitiveVertex &vertex = sphere.vertices[stack * (Slices + 1) + slice];
+            auto x = (float) (primitive_sin(phi) * primitive_cos(theta));
+            auto y = (float) primitive_cos(phi);
+            auto z = (float) (-primitive_sin(phi) * primitive_sin(theta));
+            vertex.position[0] = vertex.normal[0] = x;
+            vertex.position[1] = vertex.normal[1] = y;
+            vertex.position[2] = vertex.normal[2] = z;
+            vertex.uv[0] = (float) slice / Slices;
+            vertex.uv[1] = (float) stack / Stacks;
+        }
+    }
+    size_t i = 0;
+    for (int stack = 0; stack < Stacks; stack++) {
+        for (int slice = 0; slice < Slices; slice++) {
+            auto a = (uint16_t) (stack * (Slices + 1) + slice), b = (uint16_t) (a + 1);
+            auto c = (uint16_t) (a + Slices + 1), d = (uint16_t) (c + 1);
+            sphere.indices[i++] = a;
+            sphere.indices[i++] = c;
+            sphere.indices[i++] = b;
+            sphere.indices[i++] = b;
+            sphere.indices[i++] = c;
+            sphere.indices[i++] = d;
+        }
+    }
+    return sphere;
+}
+
+// the tables, evaluated by the compiler
+inline constexpr auto cube_primitive = make_cube();
+inline constexpr auto plane_primitive = make_plane();
+inline constexpr auto grid_primitive = make_grid<16>();
+inline constexpr auto sphere_primitive = make_sphere<16, 32>();
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "shader.h"
+
+/**
+ * On-disk program binary cache.
+ *
+ * Linked programs are saved with glGetProgramBinary under a key hashed from the driver's vendor, renderer and
+ * version strings and every stage's type and source, so a driver update or any shader edit misses the cache.
+ * A hit restores the program with glProgramBinary and skips compiling and linking; a binary the driver rejects
+ * (it may refuse any binary at any time) falls back to compiling and is rewritten.
+ * Bindings made in the setup callback are part of the binary but not of the key: clear the cache directory when
+ * they change without the sources changing.
+ * */
+
+struct ProgramCacheStats {
+    int hits = 0;
+    int misses = 0;
+};
+
+inline ProgramCacheStats program_cache_stats;
+
+// relative to the working directory, like the texture caches
+inline std::string program_cache_directory = "program_cache";
+
+inline uint64_t program_cache_hash(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    // FNV-1a
+    auto *p = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ p[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+inline bool program_binary_supported() {
+    if (!GLEW_ARB_get_program_binary) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+inline uint64_t program_cache_key(const std::vector<ShaderStage> &stages) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        auto *value = (const char *) glGetString(name);
+        std::string driver = value ? value : "";
+        hash = program_cache_hash(driver.c_str(), driver.size() + 1, hash);
+    }
+    for (const ShaderStage &stage: stages) {
+        hash = program_cache_hash(&stage.type, sizeof(stage.type), hash);
+        hash = program_cache_hash(stage.source, std::char_traits<char>::length(stage.source) + 1, hash);
+    }
+    return hash;
+}
+
+inline std::string program_cache_path(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+    return program_cache_directory + "/" + name;
+}
+
+// file layout: "PBC1", 64 bit key, GLenum binary format, binary
+inline bool read_program_binary(const std::string &path, uint64_t key, GLenum &format, std::vector<char> &binary) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    char magic[4];
+    uint64_t stored = 0;
+    in.read(magic, 4);
+    in.read((char *) &stored, sizeof(stored));
+    in.read((char *) &format, sizeof(format));
+    if (!in || std::string(magic, 4) != "PBC1" || stored != key) return false;
+    binary.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !binary.empty();
+}
+
+inline GLuint load_program_binary(const std::string &path, uint64_t key) {
+    GLenum format = 0;
+    std::vector<char> binary;
+    if (!read_program_binary(path, key, format, binary)) return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), (GLsizei) binary.size());
+    if (!program_linked(program, false)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+inline void save_program_binary(GLuint program, const std::string &path, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(program_cache_directory, error);
+    // write then rename, a crash never leaves a truncated binary behind
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) return;
+        out.write("PBC1", 4);
+        out.write((const char *) &key, sizeof(key));
+        out.write((const char *) &format, sizeof(format));
+        out.write(binary.data(), length);
+        if (!out) return;
+    }
+    std::filesystem::rename(temporary, path, error);
+}
+
+// build_program through the cache, prints the info log and returns 0 when compiling fails
+inline GLuint create_program_cached(std::initializer_list<ShaderStage> stages, const ProgramSetup &setup = {}) {
+    if (!program_binary_supported()) return build_program(stages, setup);
+
+    uint64_t key = program_cache_key(stages);
+    std::string path = program_cache_path(key);
+
+    if (GLuint program = load_program_binary(path, key)) {
+        program_cache_stats.hits++;
+        return program;
+    }
+    program_cache_stats.misses++;
+    GLuint program = build_program(stages, [&](GLuint program) {
+        if (setup) setup(program);
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    });
+    if (program) save_program_binary(program, path, key);
+    return program;
+}
+
+inline GLuint create_program_cached(const char *vertexSource, const char *fragmentSource,
+                                    const ProgramSetup &setup = {}) {
+    return create_program_cached({{GL_VERTEX_SHADER, vertexSource}, {GL_FRAGMENT_SHADER, fragmentSource}}, setup);
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vecmath.h"
+#include "vertex_format.h"
+
+/**
+ * What a linked program reads, enumerated after link: default-block uniforms, uniform blocks and vertex attributes,
+ * with their locations, types and sizes.
+ *
+ * The typed setters keep the last value of every uniform and only call glUniform* when it changes, so per-draw
+ * code can set everything every time and the driver only sees what actually differs. They need the program in
+ * use. sync() re-reflects when the program behind a handle changed (hot-reload), which also forgets the cached
+ * values since the new program starts from its defaults.
+ * */
+
+struct ProgramUniform {
+    std::string name; // arrays without the [0]
+    GLint location;
+    GLenum type;
+    GLint size; // array length, 1 otherwise
+};
+
+struct ProgramBlock {
+    std::string name;
+    GLuint index;
+    GLint size; // bytes
+};
+
+struct ProgramAttribute {
+    std::string name;
+    GLint location;
+    GLenum type;
+    GLint size;
+};
+
+inline bool is_sampler_type(GLenum type) {
+    switch (type) {
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_CUBE_SHADOW:
+        case GL_INT_SAMPLER_2D:
+        case GL_INT_SAMPLER_3D:
+        case GL_INT_SAMPLER_CUBE:
+        case GL_INT_SAMPLER_2D_ARRAY:
+        case GL_UNSIGNED_INT_SAMPLER_2D:
+        case GL_UNSIGNED_INT_SAMPLER_3D:
+        case GL_UNSIGNED_INT_SAMPLER_CUBE:
+        case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+class ProgramReflection {
+public:
+    // uniform writes that went out and that were dropped because nothing changed, since the last reset
+    int issued = 0;
+    int skipped = 0;
+
+    ProgramReflection() = default;
+
+    explicit ProgramReflection(GLuint program) {
+        reflect(program);
+    }
+
+    // reflect again when program is not the one reflected last, true when it did
+    bool sync(GLuint program) {
+        if (program == reflected) return false;
+        reflect(program);
+        return true;
+    }
+
+    void reflect(GLuint program) {
+        reflected = program;
+        uniformList.clear();
+        blockList.clear();
+        attributeList.clear();
+        slots.clear();
+        values.clear();
+        if (!program) return;
+
+        std::vector<GLchar> name(256);
+        GLint count = 0, maxLength = 0;
+
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        name.resize(std::max<size_t>(name.size(), (size_t) maxLength + 1));
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; i++) {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, (GLuint) i, (GLsizei) name.size(), nullptr, &size, &type, name.data());
+            GLint location = glGetUniformLocation(program, name.data());
+            // block members have no location, they are set through the block's buffer
+            if (location < 0) continue;
+            std::string uniformName = name.data();
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+                uniformName.resize(uniformName.size() - 3);
+            slots[uniformName] = (int) uniformList.size();
+            uniformList.push_back({uniformName, location, type, size});
+        }
+        values.resize(uniformList.size());
+
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        for (GLint i = 0; i < count; i++) {
+            GLint length = 0, size = 0;
+            glGetActiveUniformBlockiv(program, (GLuint) i, GL_UNIFORM_BLOCK_NAME_LENGTH, &length);
+            name.resize(std::max<size_t>(name.size(), (size_t) length + 1));
+            glGetActiveUniformBlockName(program, (GLuint) i, (GLsizei) name.size(), nullptr, name.data());
+            glGetActiveUniformBlockiv(program, (GLuint) i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+            blockList.push_back({name.data(), (GLuint) i, size});
+        }
+
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        name.resize(std::max<size_t>(name.size(), (size_t) maxLength + 1));
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+        for (GLint i = 0; i < count; i++) {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveAttrib(program, (GLuint) i, (GLsizei) name.size(), nullptr, &size, &type, name.data());
+            GLint location = glGetAttribLocation(program, name.data());
+            // gl_VertexID and friends
+            if (location < 0) continue;
+            attributeList.push_back({name.data(), location, type, size});
+        }
+    }
+
+    GLuint program() const {
+        return reflected;
+    }
+
+    const std::vector<ProgramUniform> &uniforms() const {
+        return uniformList;
+    }
+
+    const std::vector<ProgramBlock> &blocks() const {
+        return blockList;
+    }
+
+    const std::vector<ProgramAttribute> &attributes() const {
+        return attributeList;
+    }
+
+    const ProgramBlock *block(const std::string &name) const {
+        for (const ProgramBlock &block: blockList) {
+            if (block.name == name) return &block;
+        }
+        return nullptr;
+    }
+
+    const ProgramAttribute *attribute(const std::string &name) const {
+        for (const ProgramAttribute &attribute: attributeList) {
+            if (attribute.name == name) return &attribute;
+        }
+        return nullptr;
+    }
+
+    // look the name up once, then set by slot in per-draw code; -1 when the program has no such uniform
+    int slot(const std::string &name) const {
+        auto found = slots.find(name);
+        return found == slots.end() ? -1 : found->second;
+    }
+
+    // the setters return true when a GL call went out; a uniform the program does not have or of another type
+    // is ignored, the type mismatch is printed once
+    bool set(int slot, GLint value) {
+        return store(slot, &value, 1, 1, type_int, [&](GLint location) { glUniform1i(location, value); });
+    }
+
+    bool set(int slot, GLuint value) {
+        return store(slot, &value, 1, 1, type_uint, [&](GLint location) { glUniform1ui(location, value); });
+    }
+
+    bool set(int slot, float value) {
+        return store(slot, &value, 1, 1, type_float, [&](GLint location) { glUniform1f(location, value); });
+    }
+
+    bool set(int slot, const vec3 &value) {
+        return store(slot, &value.x, 3, 1, type_vec3, [&](GLint location) { glUniform3fv(location, 1, &value.x); });
+    }
+
+    bool set(int slot, const vec4 &value) {
+        return store(slot, &value.x, 4, 1, type_vec4, [&](GLint location) { glUniform4fv(location, 1, &value.x); });
+    }
+
+    bool set(int slot, const mat4 &value) {
+        return store(slot, value.m, 16, 1, type_mat4,
+                     [&](GLint location) { glUniformMatrix4fv(location, 1, GL_FALSE, value.m); });
+    }
+
+    // vec4 arrays, count elements from the first
+    bool set(int slot, const vec4 *value, GLsizei count) {
+        return store(slot, &value->x, 4, count, type_vec4, [&](GLint location) {
+            // vec4 is 16 byte aligned with no padding, the array is tightly packed
+            glUniform4fv(location, count, &value->x);
+        });
+    }
+
+    template<typename T>
+    bool set(const std::string &name, const T &value) {
+        return set(slot(name), value);
+    }
+
+    // every attribute the program reads has to be in the format, prints the ones that are not
+    bool matches(const VertexFormat &format) const {
+        bool ok = true;
+        for (const ProgramAttribute &attribute: attributeList) {
+            bool found = false;
+            for (const VertexAttribute &provided: format.attributes)
+                found = found || provided.location == (GLuint) attribute.location;
+            if (!found) {
+                std::cout << "Attribute " << attribute.name << " at location " << attribute.location
+                          << " is not in the vertex format" << std::endl;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    void reset_counters() {
+        issued = skipped = 0;
+    }
+
+    void print() const {
+        std::cout << "Program " << reflected << std::endl;
+        for (const ProgramUniform &uniform: uniformList)
+            std::cout << "  uniform " << uniform.name << " location " << uniform.location << " type 0x" << std::hex
+                      << uniform.type << std::dec << " size " << uniform.size << std::endl;
+        for (const ProgramBlock &block: blockList)
+            std::cout << "  block " << block.name << " index " << block.index << " " << block.size << " bytes"
+                      << std::endl;
+        for (const ProgramAttribute &attribute: attributeList)
+            std::cout << "  attribute " << attribute.name << " location " << attribute.location << " type 0x"
+                      << std::hex << attribute.type << std::dec << std::endl;
+    }
+
+private:
+    enum SetterType {
+        type_int, type_uint, type_float, type_vec3, type_vec4, type_mat4
+    };
+
+    struct Value {
+        std::vector<uint32_t> words;
+        bool valid = false;
+        bool warned = false;
+    };
+
+    GLuint reflected = 0;
+    std::vector<ProgramUniform> uniformList;
+    std::vector<ProgramBlock> blockList;
+    std::vector<ProgramAttribute> attributeList;
+    std::unordered_map<std::string, int> slots;
+    std::vector<Value> values;
+
+    static bool accepts(GLenum type, SetterType setter) {
+        switch (setter) {
+            case type_int:
+                return type == GL_INT || type == GL_BOOL || is_sampler_type(type);
+            case type_uint:
+                return type == GL_UNSIGNED_INT;
+            case type_float:
+                return type == GL_FLOAT;
+            case type_vec3:
+                return type == GL_FLOAT_VEC3;
+            case type_vec4:
+                return type == GL_FLOAT_VEC4;
+            case type_mat4:
+                return type == GL_FLOAT_MAT4;
+        }
+        return false;
+    }
+
+    // components 32 bit values per element
+    template<typename F>
+    bool store(int slot, const void *data, int components, GLsizei count, SetterType setter, F &&upload) {
+        if (slot < 0 || slot >= (int) uniformList.size()) return false;
+        const ProgramUniform &uniform = uniformList[slot];
+        Value &value = values[slot];
+        if (!accepts(uniform.type, setter)) {
+            if (!value.warned) std::cout << "Uniform " << uniform.name << " set with the wrong type" << std::endl;
+            value.warned = true;
+            return false;
+        }
+        size_t words = (size_t) components * (size_t) std::min(count, uniform.size);
+        if (value.valid && value.words.size() == words &&
+            std::memcmp(value.words.data(), data, words * sizeof(uint32_t)) == 0) {
+            skipped++;
+            return false;
+        }
+        value.words.resize(words);
+        std::memcpy(value.words.data(), data, words * sizeof(uint32_t));
+        value.valid = true;
+        upload(uniform.location);
+        issued++;
+        return true;
+    }
+};
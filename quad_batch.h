@@ -0,0 +1,157 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "atlas.h"
+#include "gl_state.h"
+#include "shader_manager.h"
+#include "texture_array.h"
+
+// one textured quad, corners in normalized device coordinates
+struct QuadInstance {
+    float rect[4];      // x0, y0, x1, y1
+    float uv[4];        // u0, v0, u1, v1
+    float layer;        // texture array layer
+    uint8_t tint[4];    // multiplied with the texel, normalized
+};
+
+/**
+ * Instanced quad batcher.
+ *
+ * Quads collected during a frame go into one instance buffer (orphaned every frame so the driver never has to
+ * wait for the previous frame's draw) and are drawn by a single glDrawArraysInstanced of a shared unit quad.
+ * Texturing goes through one GL_TEXTURE_2D_ARRAY, so any mix of atlas pages renders in the same call, or with
+ * draw_bindless() through a BindlessTextures table where the instance's layer is the slot, so any mix of textures
+ * does. The programs come from shaders/quad_batch*.{vert,frag} through the caller's ShaderManager, so they share
+ * its program cache and hot-reload; the bindless one is only loaded on the first draw_bindless().
+ * */
+class QuadBatch {
+public:
+    explicit QuadBatch(ShaderManager &shaders) : shaders(shaders) {
+        program = shaders.load("../shaders/quad_batch.vert", "../shaders/quad_batch.frag");
+
+        // unit quad as a triangle strip, corner (0, 0) maps to rect.xy / uv.xy
+        float corners[] = {
+                0.0f, 0.0f,
+                1.0f, 0.0f,
+                0.0f, 1.0f,
+                1.0f, 1.0f,
+        };
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &cornerBuffer);
+        glGenBuffers(1, &instanceBuffer);
+
+        gl_state.bind_vertex_array(VAO);
+        gl_state.bind_buffer(GL_ARRAY_BUFFER, cornerBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+        glEnableVertexAttribArray(0);
+
+        gl_state.bind_buffer(GL_ARRAY_BUFFER, instanceBuffer);
+        GLsizei stride = sizeof(QuadInstance);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void *) offsetof(QuadInstance, rect));
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void *) offsetof(QuadInstance, uv));
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void *) offsetof(QuadInstance, layer));
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *) offsetof(QuadInstance, tint));
+        for (int attribute = 1; attribute <= 4; attribute++) {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribDivisor(attribute, 1);
+        }
+        gl_state.bind_vertex_array(0);
+    }
+
+    QuadBatch(const QuadBatch &) = delete;
+
+    QuadBatch &operator=(const QuadBatch &) = delete;
+
+    ~QuadBatch() {
+        release();
+    }
+
+    // free the GL objects while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        if (!VAO) return;
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &cornerBuffer);
+        glDeleteBuffers(1, &instanceBuffer);
+        gl_state.forget_vertex_array(VAO);
+        gl_state.forget_buffer(cornerBuffer);
+        gl_state.forget_buffer(instanceBuffer);
+        VAO = 0;
+    }
+
+    // first use of the program, waits for the driver and prints the log if it failed
+    bool valid() {
+        return shaders.get(program) != 0;
+    }
+
+    void clear() {
+        quads.clear();
+    }
+
+    void add(const QuadInstance &quad) {
+        quads.push_back(quad);
+    }
+
+    void add(float x0, float y0, float x1, float y1, const AtlasRegion &region, uint32_t tint = 0xffffffff) {
+        QuadInstance quad{{x0, y0, x1, y1}, {region.u0, region.v0, region.u1, region.v1}, (float) region.page,
+                          {(uint8_t) (tint >> 24), (uint8_t) (tint >> 16), (uint8_t) (tint >> 8), (uint8_t) tint}};
+        quads.push_back(quad);
+    }
+
+    size_t size() const {
+        return quads.size();
+    }
+
+    // upload this frame's instances and draw them all with textureArray bound to unit 0
+    void draw(GLuint textureArray) {
+        GLuint id = shaders.get(program);
+        if (quads.empty() || !id) return;
+        upload();
+        gl_state.use_program(id);
+        gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, textureArray);
+        submit();
+    }
+
+    // same, but every instance samples the texture in slot `layer` of textures, needs BindlessTextures::supported()
+    void draw_bindless(const BindlessTextures &textures) {
+        if (quads.empty()) return;
+        if (!bindlessProgram)
+            bindlessProgram = shaders.load("../shaders/quad_batch_bindless.vert",
+                                           "../shaders/quad_batch_bindless.frag");
+        GLuint id = shaders.get(*bindlessProgram);
+        if (!id) return;
+        upload();
+        gl_state.use_program(id);
+        textures.bind(0);
+        submit();
+    }
+
+private:
+    ShaderManager &shaders;
+    ShaderManager::Handle program;
+    std::optional<ShaderManager::Handle> bindlessProgram;
+    GLuint VAO = 0;
+    GLuint cornerBuffer = 0;
+    GLuint instanceBuffer = 0;
+    size_t capacity = 0;
+    std::vector<QuadInstance> quads;
+
+    void upload() {
+        size_t bytes = quads.size() * sizeof(QuadInstance);
+        gl_state.bind_buffer(GL_ARRAY_BUFFER, instanceBuffer);
+        // orphan the old storage instead of overwriting what the previous frame may still read
+        capacity = std::max(capacity, bytes);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) capacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) bytes, quads.data());
+    }
+
+    void submit() {
+        gl_state.bind_vertex_array(VAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) quads.size());
+    }
+};
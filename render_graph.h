@@ -0,0 +1,462 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gl_state.h"
+
+/**
+ * Frame render graph.
+ *
+ * Passes declare the render targets they read and write and are run in dependency order; passes whose outputs
+ * nobody reads (and that do not draw to the backbuffer) are dropped. Render targets are transient: they only exist
+ * from their first writer to their last reader, and two targets of the same size and format whose lifetimes do not
+ * overlap share one texture, so a chain of post-processing passes needs two or three textures however long it is.
+ * Textures and framebuffers are pooled across compiles, a texture no compile uses any more is freed.
+ *
+ * A target is cleared when its first pass binds it (its contents are undefined otherwise, it may have belonged to
+ * another target a pass ago), and attachments that are not read after a pass are invalidated with
+ * glInvalidateFramebuffer so tiled GPUs never write them back. compile() after changing passes or targets,
+ * execute() every frame.
+ * */
+
+using RenderResource = uint32_t;
+
+struct RenderTargetDesc {
+    int width;
+    int height;
+    GLenum format; // sized internal format, e.g. GL_RGBA8 or GL_DEPTH_COMPONENT24
+};
+
+inline bool operator==(const RenderTargetDesc &a, const RenderTargetDesc &b) {
+    return a.width == b.width && a.height == b.height && a.format == b.format;
+}
+
+inline bool is_depth_format(GLenum format) {
+    return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F ||
+           format == GL_DEPTH24_STENCIL8;
+}
+
+// glTexImage2D format and type and the bytes per pixel of a sized internal format, false for unknown ones
+inline bool render_target_format(GLenum internal, GLenum &format, GLenum &type, int &bytes) {
+    switch (internal) {
+        case GL_RGBA8:
+            format = GL_RGBA, type = GL_UNSIGNED_BYTE, bytes = 4;
+            return true;
+        case GL_RGB8:
+            format = GL_RGB, type = GL_UNSIGNED_BYTE, bytes = 3;
+            return true;
+        case GL_R8:
+            format = GL_RED, type = GL_UNSIGNED_BYTE, bytes = 1;
+            return true;
+        case GL_RGBA16F:
+            format = GL_RGBA, type = GL_HALF_FLOAT, bytes = 8;
+            return true;
+        case GL_DEPTH_COMPONENT16:
+            format = GL_DEPTH_COMPONENT, type = GL_UNSIGNED_SHORT, bytes = 2;
+            return true;
+        case GL_DEPTH_COMPONENT24:
+            format = GL_DEPTH_COMPONENT, type = GL_UNSIGNED_INT, bytes = 4;
+            return true;
+        case GL_DEPTH_COMPONENT32F:
+            format = GL_DEPTH_COMPONENT, type = GL_FLOAT, bytes = 4;
+            return true;
+        case GL_DEPTH24_STENCIL8:
+            format = GL_DEPTH_STENCIL, type = GL_UNSIGNED_INT_24_8, bytes = 4;
+            return true;
+        default:
+            return false;
+    }
+}
+
+class RenderGraph {
+public:
+    RenderGraph() = default;
+
+    RenderGraph(const RenderGraph &) = delete;
+
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    ~RenderGraph() {
+        release();
+    }
+
+    // free the GL objects while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        for (Target &target: targets) delete_texture(target.texture);
+        targets.clear();
+        for (auto &entry: framebuffers) delete_framebuffer(entry.second);
+        framebuffers.clear();
+        for (Resource &resource: resources) resource.target = -1;
+    }
+
+    // drop every pass and target, the textures stay pooled for the next compile
+    void clear() {
+        passes.clear();
+        resources.clear();
+        order.clear();
+    }
+
+    // the default framebuffer: never allocated or invalidated, cleared before the first pass that draws to it
+    RenderResource backbuffer(int width, int height) {
+        resources.push_back({"backbuffer", {width, height, GL_RGBA8}, true});
+        return (RenderResource) resources.size() - 1;
+    }
+
+    RenderResource create(const std::string &name, const RenderTargetDesc &desc) {
+        resources.push_back({name, desc, false});
+        return (RenderResource) resources.size() - 1;
+    }
+
+    // outputs are the pass's attachments: color targets in draw buffer order and at most one depth target,
+    // or the backbuffer alone. Inputs are sampled with texture()
+    void add_pass(const std::string &name, std::vector<RenderResource> inputs, std::vector<RenderResource> outputs,
+                  std::function<void()> execute) {
+        Pass pass;
+        pass.name = name;
+        pass.inputs = std::move(inputs);
+        pass.outputs = std::move(outputs);
+        pass.execute = std::move(execute);
+        passes.push_back(std::move(pass));
+    }
+
+    // schedule the passes and assign textures, false (and a message) for a cycle or an unusable target
+    bool compile() {
+        order.clear();
+        if (!schedule()) return false;
+        assign();
+        return build_framebuffers();
+    }
+
+    void execute() {
+        for (size_t position: order) {
+            Pass &pass = passes[position];
+            gl_state.bind_framebuffer(pass.framebuffer);
+            const RenderTargetDesc &size = resources[pass.outputs[0]].desc;
+            gl_state.viewport(0, 0, size.width, size.height);
+            clear_outputs(pass);
+            if (pass.execute) pass.execute();
+            if (!pass.invalidate.empty() && GLEW_ARB_invalidate_subdata)
+                glInvalidateFramebuffer(GL_FRAMEBUFFER, (GLsizei) pass.invalidate.size(), pass.invalidate.data());
+        }
+    }
+
+    // the texture behind a target in the current compile, 0 for the backbuffer
+    GLuint texture(RenderResource resource) const {
+        int target = resources[resource].target;
+        return target < 0 ? 0 : targets[target].texture;
+    }
+
+    // passes run by execute(), after culling
+    size_t pass_count() const {
+        return order.size();
+    }
+
+    // textures allocated for the targets, and what they would take without aliasing
+    size_t allocated_bytes() const {
+        size_t bytes = 0;
+        for (const Target &target: targets) bytes += target_bytes(target.desc);
+        return bytes;
+    }
+
+    size_t requested_bytes() const {
+        size_t bytes = 0;
+        for (const Resource &resource: resources) {
+            if (!resource.imported && resource.first >= 0) bytes += target_bytes(resource.desc);
+        }
+        return bytes;
+    }
+
+private:
+    struct Resource {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported;
+        int first = -1, last = -1; // positions in order, -1 when no scheduled pass uses it
+        int target = -1;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<RenderResource> inputs, outputs;
+        std::function<void()> execute;
+        GLuint framebuffer = 0;
+        std::vector<RenderResource> clears;
+        std::vector<GLenum> invalidate;
+    };
+
+    struct Target {
+        RenderTargetDesc desc;
+        GLuint texture;
+        bool busy;
+        bool used;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<size_t> order;
+    std::vector<Target> targets;
+    std::map<std::vector<GLuint>, GLuint> framebuffers; // attachments, depth last
+
+    static size_t target_bytes(const RenderTargetDesc &desc) {
+        GLenum format, type;
+        int bytes = 0;
+        render_target_format(desc.format, format, type, bytes);
+        return (size_t) desc.width * desc.height * bytes;
+    }
+
+    static bool uses(const std::vector<RenderResource> &list, RenderResource resource) {
+        return std::find(list.begin(), list.end(), resource) != list.end();
+    }
+
+    // cull, then order so every writer of a target runs before its readers, declaration order otherwise
+    bool schedule() {
+        size_t count = passes.size();
+        std::vector<bool> needed(count, false);
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t i = 0; i < count; i++) {
+                if (needed[i]) continue;
+                for (RenderResource output: passes[i].outputs) {
+                    bool read = resources[output].imported;
+                    for (size_t j = 0; j < count && !read; j++) read = needed[j] && uses(passes[j].inputs, output);
+                    if (read) needed[i] = true;
+                }
+                changed = changed || needed[i];
+            }
+        }
+
+        std::vector<std::vector<size_t>> after(count);
+        std::vector<int> waiting(count, 0);
+        for (size_t i = 0; i < count; i++) {
+            if (!needed[i]) continue;
+            for (size_t j = 0; j < count; j++) {
+                if (i == j || !needed[j]) continue;
+                bool before = false;
+                for (RenderResource output: passes[i].outputs) {
+                    // writers before readers, several writers of one target in declaration order
+                    before = before || uses(passes[j].inputs, output) || (j > i && uses(passes[j].outputs, output));
+                }
+                if (before) {
+                    after[i].push_back(j);
+                    waiting[j]++;
+                }
+            }
+        }
+        std::vector<bool> done(count, false);
+        for (size_t scheduled = 0;;) {
+            size_t next = count;
+            for (size_t i = 0; i < count && next == count; i++) {
+                if (needed[i] && !done[i] && waiting[i] == 0) next = i;
+            }
+            if (next == count) {
+                size_t total = (size_t) std::count(needed.begin(), needed.end(), true);
+                if (scheduled == total) break;
+                std::cout << "Render graph has a cycle" << std::endl;
+                order.clear();
+                return false;
+            }
+            done[next] = true;
+            order.push_back(next);
+            scheduled++;
+            for (size_t j: after[next]) waiting[j]--;
+        }
+
+        for (Resource &resource: resources) resource.first = resource.last = -1;
+        for (size_t position = 0; position < order.size(); position++) {
+            const Pass &pass = passes[order[position]];
+            for (const auto *list: {&pass.inputs, &pass.outputs}) {
+                for (RenderResource used: *list) {
+                    Resource &resource = resources[used];
+                    if (resource.first < 0) resource.first = (int) position;
+                    resource.last = (int) position;
+                }
+            }
+        }
+        return true;
+    }
+
+    // give every target a texture, reusing the ones whose lifetime ended before this one starts
+    void assign() {
+        for (Target &target: targets) target.busy = target.used = false;
+        for (Resource &resource: resources) resource.target = -1;
+        for (size_t position = 0; position < order.size(); position++) {
+            for (Resource &resource: resources) {
+                if (resource.imported || resource.first != (int) position) continue;
+                for (size_t t = 0; t < targets.size() && resource.target < 0; t++) {
+                    if (!targets[t].busy && targets[t].desc == resource.desc) resource.target = (int) t;
+                }
+                if (resource.target < 0) {
+                    targets.push_back({resource.desc, create_texture(resource.desc), false, false});
+                    resource.target = (int) targets.size() - 1;
+                }
+                targets[resource.target].busy = targets[resource.target].used = true;
+            }
+            for (Resource &resource: resources) {
+                if (resource.target >= 0 && resource.last == (int) position) targets[resource.target].busy = false;
+            }
+        }
+
+        // textures no target needs any more, and the framebuffers that use them
+        std::vector<Target> kept;
+        for (Target &target: targets) {
+            if (target.used) {
+                kept.push_back(target);
+                continue;
+            }
+            for (auto entry = framebuffers.begin(); entry != framebuffers.end();) {
+                if (std::find(entry->first.begin(), entry->first.end(), target.texture) != entry->first.end()) {
+                    delete_framebuffer(entry->second);
+                    entry = framebuffers.erase(entry);
+                } else {
+                    ++entry;
+                }
+            }
+            // create_texture may be given the same name back and binds it through gl_state right away
+            delete_texture(target.texture);
+        }
+        if (kept.size() != targets.size()) {
+            std::vector<int> remap(targets.size(), -1);
+            for (size_t t = 0, k = 0; t < targets.size(); t++) {
+                if (targets[t].used) remap[t] = (int) k++;
+            }
+            for (Resource &resource: resources) {
+                if (resource.target >= 0) resource.target = remap[resource.target];
+            }
+            targets = std::move(kept);
+        }
+    }
+
+    static void delete_texture(GLuint texture) {
+        glDeleteTextures(1, &texture);
+        gl_state.forget_texture(texture);
+    }
+
+    static void delete_framebuffer(GLuint framebuffer) {
+        glDeleteFramebuffers(1, &framebuffer);
+        gl_state.forget_framebuffer(framebuffer);
+    }
+
+    static GLuint create_texture(const RenderTargetDesc &desc) {
+        GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+        int bytes = 0;
+        if (!render_target_format(desc.format, format, type, bytes))
+            std::cout << "Unknown render target format " << desc.format << std::endl;
+        GLuint texture;
+        glGenTextures(1, &texture);
+        gl_state.bind_texture(0, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, (GLint) desc.format, desc.width, desc.height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        return texture;
+    }
+
+    // one framebuffer per attachment set, plus what each pass clears before and invalidates after it runs
+    bool build_framebuffers() {
+        for (size_t position = 0; position < order.size(); position++) {
+            Pass &pass = passes[order[position]];
+            pass.framebuffer = 0;
+            pass.clears.clear();
+            pass.invalidate.clear();
+            if (pass.outputs.empty()) {
+                std::cout << "Render pass " << pass.name << " has no outputs" << std::endl;
+                return false;
+            }
+
+            std::vector<GLuint> colors;
+            GLuint depth = 0;
+            GLenum depthAttachment = GL_DEPTH_ATTACHMENT;
+            bool backbuffer = false;
+            for (RenderResource output: pass.outputs) {
+                const Resource &resource = resources[output];
+                if (resource.first == (int) position) pass.clears.push_back(output);
+                if (resource.imported) {
+                    backbuffer = true;
+                    continue;
+                }
+                bool dead = resource.last == (int) position;
+                if (is_depth_format(resource.desc.format)) {
+                    depth = texture(output);
+                    if (resource.desc.format == GL_DEPTH24_STENCIL8) depthAttachment = GL_DEPTH_STENCIL_ATTACHMENT;
+                    if (dead) pass.invalidate.push_back(depthAttachment);
+                } else {
+                    if (dead) pass.invalidate.push_back(GL_COLOR_ATTACHMENT0 + (GLenum) colors.size());
+                    colors.push_back(texture(output));
+                }
+            }
+            if (backbuffer) {
+                if (pass.outputs.size() != 1) {
+                    std::cout << "Render pass " << pass.name << " mixes the backbuffer with targets" << std::endl;
+                    return false;
+                }
+                continue;
+            }
+
+            std::vector<GLuint> key = colors;
+            key.push_back(depth);
+            auto found = framebuffers.find(key);
+            if (found != framebuffers.end()) {
+                pass.framebuffer = found->second;
+                continue;
+            }
+            GLuint framebuffer;
+            glGenFramebuffers(1, &framebuffer);
+            gl_state.bind_framebuffer(framebuffer);
+            std::vector<GLenum> drawBuffers;
+            for (size_t c = 0; c < colors.size(); c++) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum) c, GL_TEXTURE_2D, colors[c], 0);
+                drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum) c);
+            }
+            if (depth) glFramebufferTexture2D(GL_FRAMEBUFFER, depthAttachment, GL_TEXTURE_2D, depth, 0);
+            if (drawBuffers.empty()) drawBuffers.push_back(GL_NONE);
+            glDrawBuffers((GLsizei) drawBuffers.size(), drawBuffers.data());
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cout << "Render pass " << pass.name << " has an incomplete framebuffer" << std::endl;
+                delete_framebuffer(framebuffer);
+                return false;
+            }
+            framebuffers[key] = framebuffer;
+            pass.framebuffer = framebuffer;
+        }
+        return true;
+    }
+
+    void clear_outputs(const Pass &pass) const {
+        if (pass.clears.empty()) return;
+        const GLfloat black[4] = {0, 0, 0, 0};
+        const GLfloat far = 1;
+        // clears go through the write masks, the pass gets back whatever was set before
+        int colorWrites = gl_state.color_writes(), depthWrites = gl_state.depth_writes();
+        gl_state.color_mask(true);
+        gl_state.depth_mask(true);
+        GLint color = 0;
+        for (RenderResource output: pass.outputs) {
+            const Resource &resource = resources[output];
+            bool clear = std::find(pass.clears.begin(), pass.clears.end(), output) != pass.clears.end();
+            if (resource.imported) {
+                if (clear) {
+                    glClearBufferfv(GL_COLOR, 0, black);
+                    glClearBufferfv(GL_DEPTH, 0, &far);
+                }
+            } else if (is_depth_format(resource.desc.format)) {
+                if (clear && resource.desc.format == GL_DEPTH24_STENCIL8) glClearBufferfi(GL_DEPTH_STENCIL, 0, far, 0);
+                else if (clear) glClearBufferfv(GL_DEPTH, 0, &far);
+            } else {
+                if (clear) glClearBufferfv(GL_COLOR, color, black);
+                color++;
+            }
+        }
+        if (colorWrites >= 0) gl_state.color_mask(colorWrites);
+        if (depthWrites >= 0) gl_state.depth_mask(depthWrites);
+    }
+};
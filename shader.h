@@ -0,0 +1,95 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <vector>
+
+// compile status of a shader, prints the info log when it failed
+inline bool shader_compiled(GLuint shader, bool log = true) {
+    GLint isCompiled = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+    if (isCompiled == GL_FALSE && log) {
+        GLint maxLength = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxLength);
+
+        // The maxLength includes the NULL character
+        std::vector<GLchar> errorLog(maxLength + 1);
+        glGetShaderInfoLog(shader, maxLength, &maxLength, &errorLog[0]);
+        std::cout << errorLog.data() << std::endl;
+    }
+    return isCompiled != GL_FALSE;
+}
+
+// compile one stage, prints the info log and returns 0 on failure
+inline GLuint compile_shader(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    if (!shader_compiled(shader)) {
+        glDeleteShader(shader); // Don't leak the shader.
+        return 0;
+    }
+    return shader;
+}
+
+// link status of a program that was linked or loaded from a binary, prints the info log when it failed
+inline bool program_linked(GLuint program, bool log = true) {
+    GLint isLinked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+    if (isLinked == GL_FALSE && log) {
+        GLint maxLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
+        std::vector<GLchar> errorLog(maxLength + 1);
+        glGetProgramInfoLog(program, maxLength, &maxLength, &errorLog[0]);
+        std::cout << errorLog.data() << std::endl;
+    }
+    return isLinked != GL_FALSE;
+}
+
+struct ShaderStage {
+    GLenum type;
+    const char *source;
+};
+
+// runs between attaching the shaders and linking, e.g. glBindAttribLocation / glBindFragDataLocation
+using ProgramSetup = std::function<void(GLuint)>;
+
+// compile and link any set of stages, prints the info log and returns 0 on failure
+inline GLuint build_program(std::initializer_list<ShaderStage> stages, const ProgramSetup &setup = {}) {
+    std::vector<GLuint> shaders;
+    for (const ShaderStage &stage: stages) {
+        GLuint shader = compile_shader(stage.type, stage.source);
+        if (!shader) {
+            for (GLuint compiled: shaders) glDeleteShader(compiled);
+            return 0;
+        }
+        shaders.push_back(shader);
+    }
+
+    GLuint program = glCreateProgram();
+    for (GLuint shader: shaders) glAttachShader(program, shader);
+    if (setup) setup(program);
+    glLinkProgram(program);
+    // the program keeps what it needs
+    for (GLuint shader: shaders) glDeleteShader(shader);
+
+    if (!program_linked(program)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// compile and link a vertex + fragment program, prints the info log and returns 0 on failure
+inline GLuint create_program(const char *vertexSource, const char *fragmentSource) {
+    return build_program({{GL_VERTEX_SHADER, vertexSource}, {GL_FRAGMENT_SHADER, fragmentSource}});
+}
+
+// compile and link a compute program, prints the info log and returns 0 on failure
+inline GLuint create_compute_program(const char *computeSource) {
+    return build_program({{GL_COMPUTE_SHADER, computeSource}});
+}
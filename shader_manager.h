@@ -0,0 +1,327 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "file_watcher.h"
+#include "gl_state.h"
+#include "program_cache.h"
+#include "shader.h"
+
+/**
+ * Deferred program creation and shader hot-reload.
+ *
+ * submit() hands every compile and link to the driver without asking for the result, so the driver can work
+ * through them while the application goes on loading textures and building buffers. With
+ * GL_KHR_parallel_shader_compile it compiles on its own threads and ready() can poll GL_COMPLETION_STATUS_KHR
+ * without blocking. get() checks status on first use only, blocking for that one program at most,
+ * prints the logs of a failed program, stores new binaries in the program cache and runs the `linked` callback
+ * (block bindings, uniform locations).
+ * Cached binaries are submitted with glProgramBinary the same way; a binary the driver rejects is recompiled from
+ * the sources kept for that purpose.
+ *
+ * load() reads the stages from files instead. After watch(directory), update() (once per frame, between frames)
+ * recompiles only the programs that use a changed file; the new program replaces the old one in its handle once
+ * the driver is done with it, in the background with GL_KHR_parallel_shader_compile. A program that fails to
+ * compile or link prints its log and the old one stays. Callers should get() the program every frame rather than
+ * keep the GLuint.
+ * */
+
+struct ShaderFile {
+    GLenum type;
+    const char *path;
+};
+
+inline bool read_shader_file(const std::string &path, std::string &source) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cout << "Failed to read shader " << path << std::endl;
+        return false;
+    }
+    source.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// `#define NAME` lines right after the #version line, which has to stay first
+inline std::string inject_defines(const std::string &source, const std::vector<std::string> &defines) {
+    if (defines.empty()) return source;
+    std::string block;
+    for (const std::string &define: defines) block += "#define " + define + "\n";
+    size_t version = source.find("#version");
+    size_t line = version == std::string::npos ? 0 : source.find('\n', version);
+    if (line == std::string::npos) return source + "\n" + block;
+    if (version != std::string::npos) line++;
+    return source.substr(0, line) + block + source.substr(line);
+}
+
+class ShaderManager {
+public:
+    using Handle = size_t;
+
+    ShaderManager() = default;
+
+    ShaderManager(const ShaderManager &) = delete;
+
+    ShaderManager &operator=(const ShaderManager &) = delete;
+
+    ~ShaderManager() {
+        release();
+    }
+
+    // free the GL objects while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        watcher.reset();
+        for (Entry &entry: entries) {
+            discard(entry.shaders);
+            discard(entry.pending_shaders);
+            if (entry.program) delete_program(entry.program);
+            if (entry.pending) delete_program(entry.pending);
+            entry.program = entry.pending = 0;
+        }
+        entries.clear();
+    }
+
+    // setup runs before linking (attribute / frag data locations), linked after the first successful get()
+    // and after every reload
+    Handle submit(std::initializer_list<ShaderStage> stages, const ProgramSetup &setup = {},
+                  const ProgramSetup &linked = {}) {
+        Entry entry;
+        for (const ShaderStage &stage: stages) entry.sources.emplace_back(stage.type, stage.source);
+        return add(std::move(entry), setup, linked);
+    }
+
+    Handle submit(const char *vertexSource, const char *fragmentSource, const ProgramSetup &setup = {},
+                  const ProgramSetup &linked = {}) {
+        return submit({{GL_VERTEX_SHADER, vertexSource}, {GL_FRAGMENT_SHADER, fragmentSource}}, setup, linked);
+    }
+
+    // a program whose stages come from files; if one cannot be read, get() returns 0 until a reload succeeds.
+    // defines are injected into every stage, also when it is reloaded
+    Handle load(const std::vector<ShaderFile> &files, const ProgramSetup &setup = {},
+                const ProgramSetup &linked = {}, const std::vector<std::string> &defines = {}) {
+        Entry entry;
+        entry.defines = defines;
+        for (const ShaderFile &file: files) {
+            entry.paths.push_back(std::filesystem::path(file.path).lexically_normal().string());
+            entry.sources.emplace_back(file.type, std::string());
+        }
+        entry.missing = !read_sources(entry);
+        return add(std::move(entry), setup, linked);
+    }
+
+    Handle load(const char *vertexPath, const char *fragmentPath, const ProgramSetup &setup = {},
+                const ProgramSetup &linked = {}) {
+        return load({{GL_VERTEX_SHADER, vertexPath}, {GL_FRAGMENT_SHADER, fragmentPath}}, setup, linked);
+    }
+
+    // reload programs loaded from files in directory when those files change
+    void watch(const std::string &directory) {
+        watcher = std::make_unique<FileWatcher>(directory);
+        if (!watcher->available()) {
+            std::cout << "Cannot watch " << directory << ", shader hot-reload is off" << std::endl;
+            watcher.reset();
+        }
+    }
+
+    // start recompiling programs whose files changed, swap in the ones that are done;
+    // true when a program changed
+    bool update() {
+        if (watcher) {
+            for (const std::string &path: watcher->changed()) {
+                for (Entry &entry: entries) {
+                    if (std::find(entry.paths.begin(), entry.paths.end(), path) == entry.paths.end()) continue;
+                    if (!read_sources(entry)) continue;
+                    // a newer edit replaces a reload that is still compiling
+                    if (entry.pending) delete_program(entry.pending);
+                    discard(entry.pending_shaders);
+                    entry.pending = compile(entry, entry.pending_shaders);
+                }
+            }
+        }
+        bool swapped = false;
+        for (Entry &entry: entries) {
+            if (!entry.pending || !done(entry.pending)) continue;
+            bool ok = succeeded(entry.pending, entry.pending_shaders);
+            discard(entry.pending_shaders);
+            if (!ok) {
+                std::cout << "Reload failed, keeping the previous program" << std::endl;
+                delete_program(entry.pending);
+                entry.pending = 0;
+                continue;
+            }
+            // the old program finishes the draws already issued with it
+            if (entry.program) delete_program(entry.program);
+            discard(entry.shaders);
+            entry.program = entry.pending;
+            entry.pending = 0;
+            entry.resolved = true;
+            entry.missing = false;
+            entry.from_binary = false;
+            if (cache) {
+                entry.key = program_cache_key(stages(entry));
+                save_program_binary(entry.program, program_cache_path(entry.key), entry.key);
+            }
+            if (entry.linked) entry.linked(entry.program);
+            swapped = true;
+        }
+        return swapped;
+    }
+
+    // true when get() will not wait for the driver; always true without GL_KHR_parallel_shader_compile,
+    // where there is no way to ask
+    bool ready(Handle handle) const {
+        const Entry &entry = entries[handle];
+        return entry.resolved || !entry.program || done(entry.program);
+    }
+
+    // the linked program, 0 if it failed
+    GLuint get(Handle handle) {
+        Entry &entry = entries[handle];
+        if (!entry.resolved) resolve(entry);
+        return entry.program;
+    }
+
+private:
+    struct Entry {
+        std::vector<std::pair<GLenum, std::string>> sources;
+        std::vector<std::string> paths; // per stage, empty for submitted sources
+        std::vector<std::string> defines;
+        ProgramSetup setup, linked;
+        std::vector<GLuint> shaders, pending_shaders;
+        GLuint program = 0;
+        GLuint pending = 0; // reload in flight
+        uint64_t key = 0;
+        bool from_binary = false;
+        bool resolved = false;
+        bool missing = false;
+    };
+
+    std::vector<Entry> entries;
+    std::unique_ptr<FileWatcher> watcher;
+    bool started = false, parallel = false, cache = false;
+
+    // needs the context, so not in the constructor
+    void start() {
+        started = true;
+        parallel = GLEW_KHR_parallel_shader_compile;
+        // let the driver pick how many compiler threads to use
+        if (parallel) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        cache = program_binary_supported();
+    }
+
+    static std::vector<ShaderStage> stages(const Entry &entry) {
+        std::vector<ShaderStage> stages;
+        for (const auto &source: entry.sources) stages.push_back({source.first, source.second.c_str()});
+        return stages;
+    }
+
+    static bool read_sources(Entry &entry) {
+        bool ok = true;
+        for (size_t i = 0; i < entry.paths.size(); i++) {
+            std::string &source = entry.sources[i].second;
+            ok = read_shader_file(entry.paths[i], source) && ok;
+            source = inject_defines(source, entry.defines);
+        }
+        return ok;
+    }
+
+    // a reloaded program can come back with the name of the one it replaced, gl_state must not skip binding it
+    static void delete_program(GLuint program) {
+        glDeleteProgram(program);
+        gl_state.forget_program(program);
+    }
+
+    static void discard(std::vector<GLuint> &shaders) {
+        for (GLuint shader: shaders) glDeleteShader(shader);
+        shaders.clear();
+    }
+
+    Handle add(Entry &&entry, const ProgramSetup &setup, const ProgramSetup &linked) {
+        if (!started) start();
+        entry.setup = setup;
+        entry.linked = linked;
+        if (entry.missing) {
+            entry.resolved = true;
+        } else {
+            if (cache) {
+                entry.key = program_cache_key(stages(entry));
+                GLenum format = 0;
+                std::vector<char> binary;
+                if (read_program_binary(program_cache_path(entry.key), entry.key, format, binary)) {
+                    entry.program = glCreateProgram();
+                    glProgramBinary(entry.program, format, binary.data(), (GLsizei) binary.size());
+                    entry.from_binary = true;
+                }
+            }
+            if (!entry.program) entry.program = compile(entry, entry.shaders);
+        }
+        entries.push_back(std::move(entry));
+        return entries.size() - 1;
+    }
+
+    // no status queries here, they would make the driver finish the work
+    GLuint compile(const Entry &entry, std::vector<GLuint> &shaders) const {
+        GLuint program = glCreateProgram();
+        for (const auto &source: entry.sources) {
+            GLuint shader = glCreateShader(source.first);
+            const char *text = source.second.c_str();
+            glShaderSource(shader, 1, &text, nullptr);
+            glCompileShader(shader);
+            glAttachShader(program, shader);
+            shaders.push_back(shader);
+        }
+        if (entry.setup) entry.setup(program);
+        if (cache) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        return program;
+    }
+
+    bool done(GLuint program) const {
+        if (!parallel) return true;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete != GL_FALSE;
+    }
+
+    // compile and link status, the logs of whatever failed are printed
+    static bool succeeded(GLuint program, const std::vector<GLuint> &shaders) {
+        bool ok = true;
+        for (GLuint shader: shaders) ok = shader_compiled(shader) && ok;
+        return ok && program_linked(program);
+    }
+
+    void resolve(Entry &entry) {
+        entry.resolved = true;
+        if (entry.from_binary) {
+            if (program_linked(entry.program, false)) {
+                program_cache_stats.hits++;
+                if (entry.linked) entry.linked(entry.program);
+                return;
+            }
+            // stale for this driver after all, compile and wait for it right away
+            delete_program(entry.program);
+            entry.from_binary = false;
+            entry.program = compile(entry, entry.shaders);
+        }
+        if (cache) program_cache_stats.misses++;
+
+        bool ok = succeeded(entry.program, entry.shaders);
+        discard(entry.shaders);
+        if (!ok) {
+            delete_program(entry.program);
+            entry.program = 0;
+            return;
+        }
+        if (cache) save_program_binary(entry.program, program_cache_path(entry.key), entry.key);
+        if (entry.linked) entry.linked(entry.program);
+    }
+};
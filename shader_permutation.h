@@ -0,0 +1,99 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "shader_manager.h"
+#include "uniform_ring.h"
+
+/**
+ * Shader permutations: one set of GLSL files with #ifdef'd features, specialized per combination of feature flags
+ * by injecting `#define`s after the #version line. A combination is a plain bit mask, so the key of every
+ * permutation a demo uses is a compile-time constant and the branches are resolved by the GLSL preprocessor,
+ * never per fragment.
+ *
+ * Only the permutations that are asked for are compiled: require() submits one to the ShaderManager (compiled in
+ * the background, restored from the program cache, hot-reloaded with the files) and get() resolves it.
+ * */
+
+struct PermutationFlag {
+    uint32_t bit;
+    const char *define;
+};
+
+// the defines of one combination, in flag order so equal keys give equal sources (and program cache keys)
+inline std::vector<std::string> permutation_defines(uint32_t key, const std::vector<PermutationFlag> &flags) {
+    std::vector<std::string> defines;
+    for (const PermutationFlag &flag: flags) {
+        if (key & flag.bit) defines.emplace_back(flag.define);
+    }
+    return defines;
+}
+
+class ShaderPermutations {
+public:
+    ShaderPermutations(ShaderManager &shaders, std::initializer_list<ShaderFile> files,
+                       std::initializer_list<PermutationFlag> flags, ProgramSetup setup = {},
+                       ProgramSetup linked = {})
+            : shaders(shaders), flags(flags), setup(std::move(setup)), linked(std::move(linked)) {
+        for (const ShaderFile &file: files) stages.emplace_back(file.type, file.path);
+    }
+
+    // submit the permutation now, so the driver can work on it before first use
+    ShaderManager::Handle require(uint32_t key) {
+        auto found = handles.find(key);
+        if (found != handles.end()) return found->second;
+        std::vector<ShaderFile> files;
+        for (const auto &stage: stages) files.push_back({stage.first, stage.second.c_str()});
+        ShaderManager::Handle handle = shaders.load(files, setup, linked, permutation_defines(key, flags));
+        handles[key] = handle;
+        return handle;
+    }
+
+    // the linked permutation, 0 if it failed
+    GLuint get(uint32_t key) {
+        return shaders.get(require(key));
+    }
+
+    size_t size() const {
+        return handles.size();
+    }
+
+private:
+    ShaderManager &shaders;
+    std::vector<PermutationFlag> flags;
+    ProgramSetup setup, linked;
+    std::vector<std::pair<GLenum, std::string>> stages;
+    std::map<uint32_t, ShaderManager::Handle> handles;
+};
+
+// features of shaders/surface.vert and surface.frag
+enum SurfaceFeature : uint32_t {
+    SurfaceTextured = 1u << 0,    // sampler t at uv
+    SurfaceVertexColor = 1u << 1, // per-vertex color
+    SurfaceTransform = 1u << 2,   // Camera and Object blocks, positions otherwise in clip space
+};
+
+// attribute locations of the surface shaders, the vertex formats use the same
+enum SurfaceAttribute : GLuint {
+    SurfacePosition = 0,
+    SurfaceColor = 1,
+    SurfaceUv = 2,
+};
+
+inline ShaderPermutations surface_permutations(ShaderManager &shaders) {
+    return {shaders,
+            {{GL_VERTEX_SHADER, "../shaders/surface.vert"}, {GL_FRAGMENT_SHADER, "../shaders/surface.frag"}},
+            {{SurfaceTextured, "TEXTURED"}, {SurfaceVertexColor, "VERTEX_COLOR"}, {SurfaceTransform, "TRANSFORM"}},
+            [](GLuint id) {
+                glBindAttribLocation(id, SurfacePosition, "pos");
+                glBindAttribLocation(id, SurfaceColor, "color");
+                glBindAttribLocation(id, SurfaceUv, "uv");
+                glBindFragDataLocation(id, 0, "fragColor");
+            },
+            bind_uniform_blocks};
+}
@@ -0,0 +1,15 @@
+#version 430 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 color;
+layout (location = 3) in uint objectId;
+out vec4 ocolor;
+layout (std140) uniform Camera {
+    mat4 viewProjection;
+};
+layout (std430, binding = 3) readonly buffer Models {
+    mat4 models[];
+};
+void main() {
+    gl_Position = viewProjection * models[objectId] * vec4(pos, 1.0);
+    ocolor = vec4(color, 1.0);
+}
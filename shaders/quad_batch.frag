@@ -0,0 +1,10 @@
+#version 300 es
+// QuadBatch::draw, the instance's layer of the texture array on unit 0
+out lowp vec4 fragColor;
+in highp vec3 texCoord;
+in lowp vec4 color;
+uniform lowp sampler2DArray t;
+
+void main() {
+    fragColor = texture(t, texCoord) * color;
+}
@@ -0,0 +1,15 @@
+#version 300 es
+// QuadBatch::draw, one instance per quad (see quad_batch.h)
+layout (location = 0) in vec2 corner;
+layout (location = 1) in vec4 rect;
+layout (location = 2) in vec4 uvRect;
+layout (location = 3) in float layer;
+layout (location = 4) in vec4 tint;
+out highp vec3 texCoord;
+out lowp vec4 color;
+
+void main() {
+    gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);
+    texCoord = vec3(mix(uvRect.xy, uvRect.zw, corner), layer);
+    color = tint;
+}
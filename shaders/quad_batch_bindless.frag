@@ -0,0 +1,14 @@
+#version 430 core
+#extension GL_ARB_bindless_texture : require
+// QuadBatch::draw_bindless, resident handles of a BindlessTextures table
+layout (std430, binding = 0) readonly buffer Textures {
+    uvec2 handles[];
+};
+in vec2 texCoord;
+flat in uint slot;
+in vec4 color;
+out vec4 fragColor;
+
+void main() {
+    fragColor = texture(sampler2D(handles[slot]), texCoord) * color;
+}
@@ -0,0 +1,17 @@
+#version 430 core
+// QuadBatch::draw_bindless, the instance's layer is its slot in the handle buffer
+layout (location = 0) in vec2 corner;
+layout (location = 1) in vec4 rect;
+layout (location = 2) in vec4 uvRect;
+layout (location = 3) in float layer;
+layout (location = 4) in vec4 tint;
+out vec2 texCoord;
+flat out uint slot;
+out vec4 color;
+
+void main() {
+    gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);
+    texCoord = mix(uvRect.xy, uvRect.zw, corner);
+    slot = uint(layer);
+    color = tint;
+}
@@ -0,0 +1,5 @@
+#version 300 es
+out lowp vec4 fragColor;
+void main() {
+    fragColor = vec4(1.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,5 @@
+#version 300 es
+in vec3 aPos;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+}
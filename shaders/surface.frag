@@ -0,0 +1,21 @@
+#version 300 es
+// permutations: TEXTURED, VERTEX_COLOR (see shader_permutation.h)
+out lowp vec4 fragColor;
+#ifdef VERTEX_COLOR
+in lowp vec4 ocolor;
+#endif
+#ifdef TEXTURED
+in highp vec2 texCoord;
+uniform sampler2D t;
+#endif
+
+void main() {
+    lowp vec4 color = vec4(1.0);
+#ifdef VERTEX_COLOR
+    color *= ocolor;
+#endif
+#ifdef TEXTURED
+    color *= texture(t, texCoord);
+#endif
+    fragColor = color;
+}
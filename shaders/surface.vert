@@ -0,0 +1,33 @@
+#version 300 es
+// permutations: TEXTURED, VERTEX_COLOR, TRANSFORM (see shader_permutation.h)
+in highp vec3 pos;
+#ifdef VERTEX_COLOR
+in lowp vec3 color;
+out lowp vec4 ocolor;
+#endif
+#ifdef TEXTURED
+in highp vec2 uv;
+out highp vec2 texCoord;
+#endif
+#ifdef TRANSFORM
+layout (std140) uniform Camera {
+    mat4 viewProjection;
+};
+layout (std140) uniform Object {
+    mat4 model;
+};
+#endif
+
+void main() {
+#ifdef TRANSFORM
+    gl_Position = viewProjection * model * vec4(pos, 1.0);
+#else
+    gl_Position = vec4(pos, 1.0);
+#endif
+#ifdef VERTEX_COLOR
+    ocolor = vec4(color, 1.0);
+#endif
+#ifdef TEXTURED
+    texCoord = uv;
+#endif
+}
@@ -0,0 +1,6 @@
+#version 430 core
+in vec4 ocolor;
+layout (location = 0) out vec4 fragColor;
+void main() {
+    fragColor = ocolor;
+}
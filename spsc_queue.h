@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// bounded lock-free queue for exactly one producer thread and one consumer thread, N has to be a power of two
+template<typename T, size_t N>
+class SpscQueue {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // false when the queue is full, item is left untouched then
+    bool push(T &&item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) return false;
+        items[t & (N - 1)] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = std::move(items[h & (N - 1)]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, N> items;
+    // on separate cache lines so producer and consumer do not false share
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
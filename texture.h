@@ -0,0 +1,75 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// stb_image.h has no guard around its implementation, only pull it in once
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+
+// decoded 8 bit image in its native channel count
+struct Image {
+    unsigned char *data = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+// load an image without expanding it (desired_channels = 0)
+inline Image load_image(const char *path) {
+    Image image;
+    image.data = stbi_load(path, &image.width, &image.height, &image.channels, 0);
+    return image;
+}
+
+inline GLenum image_internal_format(int channels) {
+    switch (channels) {
+        case 1:
+            return GL_R8;
+        case 2:
+            return GL_RG8;
+        case 3:
+            return GL_RGB8;
+        default:
+            return GL_RGBA8;
+    }
+}
+
+inline GLenum image_format(int channels) {
+    switch (channels) {
+        case 1:
+            return GL_RED;
+        case 2:
+            return GL_RG;
+        case 3:
+            return GL_RGB;
+        default:
+            return GL_RGBA;
+    }
+}
+
+// 1 and 2 channel textures are stored as R8/RG8, swizzle them so that
+// texture(t, texCoord) still returns grey (+ alpha) in rgb(a)
+inline void set_texture_swizzle(int channels) {
+    GLint swizzle[4] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+    if (channels == 1) {
+        swizzle[1] = GL_RED;
+        swizzle[2] = GL_RED;
+        swizzle[3] = GL_ONE;
+    } else if (channels == 2) {
+        swizzle[1] = GL_RED;
+        swizzle[2] = GL_RED;
+        swizzle[3] = GL_GREEN;
+    }
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+// (re)specify a level of texture with image in its native format
+inline void upload_image(GLuint texture, const Image &image, int level = 0) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    // R8 and RGB8 rows are not necessarily 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, level, (GLint) image_internal_format(image.channels), image.width, image.height, 0,
+                 image_format(image.channels), GL_UNSIGNED_BYTE, image.data);
+    set_texture_swizzle(image.channels);
+}
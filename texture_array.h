@@ -0,0 +1,188 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "gl_state.h"
+#include "material.h"
+#include "texture.h"
+
+/**
+ * Backends that let one draw sample many textures: same sized images as layers of a GL_TEXTURE_2D_ARRAY, or,
+ * with GL_ARB_bindless_texture, resident 64 bit handles of any textures stored in a shader storage buffer.
+ * Either way the instance picks its texture by index instead of the CPU binding it per draw.
+ * */
+
+// image as RGBA8, grey (+ alpha) expanded the same way the swizzle in texture.h shows it
+inline std::vector<unsigned char> expand_to_rgba(const Image &image) {
+    std::vector<unsigned char> rgba((size_t) image.width * image.height * 4);
+    for (size_t i = 0; i < (size_t) image.width * image.height; i++) {
+        const unsigned char *src = image.data + i * image.channels;
+        unsigned char *dst = &rgba[i * 4];
+        bool grey = image.channels < 3;
+        dst[0] = src[0];
+        dst[1] = grey ? src[0] : src[1];
+        dst[2] = grey ? src[0] : src[2];
+        dst[3] = image.channels == 2 ? src[1] : image.channels == 4 ? src[3] : 255;
+    }
+    return rgba;
+}
+
+// write image into a level of layer of the GL_TEXTURE_2D_ARRAY bound to the active unit. Binds nothing itself, so
+// the upload thread (whose context does not use gl_state) can use it too
+inline void upload_array_layer(int layer, const Image &image, int level = 0) {
+    std::vector<unsigned char> expanded;
+    const unsigned char *rgba = image.data;
+    if (image.channels != 4) {
+        expanded = expand_to_rgba(image);
+        rgba = expanded.data();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, image.width, image.height, 1, GL_RGBA,
+                    GL_UNSIGNED_BYTE, rgba);
+}
+
+// GL_TEXTURE_2D_ARRAY with a full mip chain for images of one size, storage for all layers is allocated up front.
+// RGBA8 unless format says otherwise, e.g. bc_format(4) to keep the layers block compressed. Layers are filled with
+// add(), or reserve()d and filled elsewhere (the upload thread, a PBO ring), which compressed arrays require
+class TextureArray {
+public:
+    TextureArray(int width, int height, int layers, GLenum format = GL_RGBA8)
+            : width(width), height(height), capacity(layers), internalFormat(format) {
+        glGenTextures(1, &array);
+        gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, array);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, mip_levels(), format, width, height, layers);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    TextureArray(const TextureArray &) = delete;
+
+    TextureArray &operator=(const TextureArray &) = delete;
+
+    ~TextureArray() {
+        release();
+    }
+
+    // free the GL texture while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        if (array) {
+            glDeleteTextures(1, &array);
+            gl_state.forget_texture(array);
+        }
+        array = 0;
+    }
+
+    // the next free layer, -1 if the array is full
+    int reserve() {
+        return count == capacity ? -1 : count++;
+    }
+
+    // copy image into the next free layer, -1 if it has a different size, the array is full or compressed.
+    // Call finish() once the batch of adds is done to rebuild the mip levels.
+    int add(const Image &image) {
+        if (image.width != width || image.height != height || internalFormat != GL_RGBA8) return -1;
+        int layer = reserve();
+        if (layer < 0) return -1;
+        gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, array);
+        upload_array_layer(layer, image);
+        return layer;
+    }
+
+    void finish() const {
+        gl_state.bind_texture(0, GL_TEXTURE_2D_ARRAY, array);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+
+    GLuint texture() const {
+        return array;
+    }
+
+    GLenum format() const {
+        return internalFormat;
+    }
+
+    int mip_levels() const {
+        int levels = 1;
+        for (int size = std::max(width, height); size > 1; size /= 2) levels++;
+        return levels;
+    }
+
+private:
+    int width;
+    int height;
+    int capacity;
+    GLenum internalFormat;
+    int count = 0;
+    GLuint array = 0;
+};
+
+// resident bindless handles of a MaterialTable's textures, indexed by slot in a shader storage buffer
+class BindlessTextures {
+public:
+    static bool supported() {
+        return GLEW_ARB_bindless_texture && GLEW_ARB_shader_storage_buffer_object;
+    }
+
+    BindlessTextures() {
+        glGenBuffers(1, &buffer);
+    }
+
+    BindlessTextures(const BindlessTextures &) = delete;
+
+    BindlessTextures &operator=(const BindlessTextures &) = delete;
+
+    ~BindlessTextures() {
+        release();
+    }
+
+    // free the GL objects while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        for (auto &entry: resident) glMakeTextureHandleNonResidentARB(entry.second);
+        resident.clear();
+        if (buffer) {
+            glDeleteBuffers(1, &buffer);
+            gl_state.forget_buffer(buffer);
+        }
+        buffer = 0;
+    }
+
+    // mirror materials into the handle buffer, only writes the buffer when a slot changed.
+    // Textures become immutable (sampler state included) once their handle is taken.
+    void update(const MaterialTable &materials) {
+        std::vector<GLuint64> next(materials.textures.size(), 0);
+        for (size_t slot = 0; slot < next.size(); slot++) {
+            if (materials.textures[slot]) next[slot] = handle(materials.textures[slot]);
+        }
+        if (next == handles) return;
+        gl_state.bind_buffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        if (next.size() != handles.size())
+            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) (next.size() * sizeof(GLuint64)), next.data(),
+                         GL_DYNAMIC_DRAW);
+        else
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr) (next.size() * sizeof(GLuint64)), next.data());
+        handles = std::move(next);
+    }
+
+    void bind(GLuint binding = 0) const {
+        gl_state.bind_buffer_base(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+    }
+
+private:
+    GLuint buffer = 0;
+    std::vector<GLuint64> handles;
+    std::vector<std::pair<GLuint, GLuint64>> resident;
+
+    GLuint64 handle(GLuint texture) {
+        for (auto &entry: resident) {
+            if (entry.first == texture) return entry.second;
+        }
+        GLuint64 h = glGetTextureHandleARB(texture);
+        glMakeTextureHandleResidentARB(h);
+        resident.emplace_back(texture, h);
+        return h;
+    }
+};
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+/**
+ * Loader for precompressed KTX2 and DDS textures (BC1-BC7).
+ *
+ * The file is memory-mapped and every level / layer / face is handed to glCompressedTexSubImage* straight from the
+ * mapping, nothing is decoded on the CPU. Mip chains, cube maps, arrays and cube map arrays are supported.
+ * */
+
+struct TextureFileImage {
+    int level = 0;
+    int layer = 0;
+    int face = 0;
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+
+struct TextureFile {
+    MappedFile file;
+    GLenum format = 0;
+    int width = 0;
+    int height = 0;
+    int levels = 1;
+    int layers = 0; // 0 when not an array texture
+    int faces = 1;  // 6 for cube maps
+    std::vector<TextureFileImage> images;
+};
+
+inline int texture_file_block_bytes(GLenum format) {
+    switch (format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+            return 8;
+        default:
+            return 16;
+    }
+}
+
+inline size_t texture_file_level_size(GLenum format, int width, int height, int level) {
+    size_t blocks_x = (std::max(1, width >> level) + 3) / 4, blocks_y = (std::max(1, height >> level) + 3) / 4;
+    return blocks_x * blocks_y * texture_file_block_bytes(format);
+}
+
+// a * b, false when it does not fit into a size_t
+inline bool texture_file_multiply(size_t a, size_t b, size_t &out) {
+    if (b && a > SIZE_MAX / b) return false;
+    out = a * b;
+    return true;
+}
+
+// header values are only trusted once they pass this: sizes and layer counts that fit an int, at most the levels of
+// a full mip chain (so width >> level stays below the type's width) and 1 or 6 faces
+inline bool texture_file_shape_valid(uint32_t width, uint32_t height, uint32_t levels, uint32_t layers,
+                                     uint32_t faces) {
+    if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX || layers > INT_MAX) return false;
+    if (faces != 1 && faces != 6) return false;
+    if ((uint64_t) std::max<uint32_t>(layers, 1) * faces > INT_MAX) return false;
+    uint32_t full_chain = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size >>= 1) full_chain++;
+    return levels >= 1 && levels <= full_chain;
+}
+
+template<typename T>
+T texture_file_read(const unsigned char *p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+inline GLenum dds_dxgi_format(uint32_t dxgi) {
+    switch (dxgi) {
+        case 71:
+            return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case 72:
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+        case 74:
+            return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        case 75:
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+        case 77:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case 78:
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case 80:
+            return GL_COMPRESSED_RED_RGTC1;
+        case 81:
+            return GL_COMPRESSED_SIGNED_RED_RGTC1;
+        case 83:
+            return GL_COMPRESSED_RG_RGTC2;
+        case 84:
+            return GL_COMPRESSED_SIGNED_RG_RGTC2;
+        case 95:
+            return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+        case 96:
+            return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+        case 98:
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case 99:
+            return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+        default:
+            return 0;
+    }
+}
+
+inline GLenum dds_fourcc_format(const unsigned char *fourcc) {
+    std::string code((const char *) fourcc, 4);
+    if (code == "DXT1") return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    if (code == "DXT3") return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+    if (code == "DXT5") return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    if (code == "ATI1" || code == "BC4U") return GL_COMPRESSED_RED_RGTC1;
+    if (code == "BC4S") return GL_COMPRESSED_SIGNED_RED_RGTC1;
+    if (code == "ATI2" || code == "BC5U") return GL_COMPRESSED_RG_RGTC2;
+    if (code == "BC5S") return GL_COMPRESSED_SIGNED_RG_RGTC2;
+    return 0;
+}
+
+inline GLenum ktx2_vk_format(uint32_t vk) {
+    switch (vk) {
+        case 131:
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case 132:
+            return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case 133:
+            return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case 134:
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+        case 135:
+            return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        case 136:
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+        case 137:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case 138:
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case 139:
+            return GL_COMPRESSED_RED_RGTC1;
+        case 140:
+            return GL_COMPRESSED_SIGNED_RED_RGTC1;
+        case 141:
+            return GL_COMPRESSED_RG_RGTC2;
+        case 142:
+            return GL_COMPRESSED_SIGNED_RG_RGTC2;
+        case 143:
+            return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+        case 144:
+            return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+        case 145:
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case 146:
+            return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+        default:
+            return 0;
+    }
+}
+
+// DDS stores every array element / face with its whole mip chain, one after another
+inline bool load_dds(TextureFile &texture) {
+    const unsigned char *p = texture.file.data;
+    size_t size = texture.file.size;
+    if (size < 128 || std::memcmp(p, "DDS ", 4) != 0) return false;
+
+    uint32_t height = texture_file_read<uint32_t>(p + 12);
+    uint32_t width = texture_file_read<uint32_t>(p + 16);
+    uint32_t levels = std::max(1u, texture_file_read<uint32_t>(p + 28));
+    uint32_t pixel_flags = texture_file_read<uint32_t>(p + 80);
+    uint32_t caps2 = texture_file_read<uint32_t>(p + 112);
+    if (!(pixel_flags & 0x4)) return false; // DDPF_FOURCC, only compressed data
+
+    size_t offset = 128;
+    uint32_t elements = 1, faces = caps2 & 0x200 ? 6 : 1; // DDSCAPS2_CUBEMAP
+    if (std::memcmp(p + 84, "DX10", 4) == 0) {
+        if (size < 148) return false;
+        texture.format = dds_dxgi_format(texture_file_read<uint32_t>(p + 128));
+        if (texture_file_read<uint32_t>(p + 136) & 0x4) faces = 6; // RESOURCE_MISC_TEXTURECUBE
+        elements = std::max(1u, texture_file_read<uint32_t>(p + 140));
+        offset = 148;
+    } else {
+        texture.format = dds_fourcc_format(p + 84);
+    }
+    if (!texture.format || !texture_file_shape_valid(width, height, levels, elements, faces)) return false;
+    texture.width = (int) width;
+    texture.height = (int) height;
+    texture.levels = (int) levels;
+    texture.faces = (int) faces;
+    int layers = (int) elements;
+    if (layers > 1) texture.layers = layers;
+
+    for (int layer = 0; layer < layers; layer++) {
+        for (int face = 0; face < texture.faces; face++) {
+            for (int level = 0; level < texture.levels; level++) {
+                size_t bytes = texture_file_level_size(texture.format, texture.width, texture.height, level);
+                // offset never passes size, so this can not wrap
+                if (bytes > size - offset) return false;
+                texture.images.push_back({level, layer, face, p + offset, bytes});
+                offset += bytes;
+            }
+        }
+    }
+    return true;
+}
+
+// KTX2 has a level index, each level holds all layers and faces back to back
+inline bool load_ktx2(TextureFile &texture) {
+    static const unsigned char identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    const unsigned char *p = texture.file.data;
+    size_t size = texture.file.size;
+    if (size < 80 || std::memcmp(p, identifier, 12) != 0) return false;
+
+    texture.format = ktx2_vk_format(texture_file_read<uint32_t>(p + 12));
+    uint32_t width = texture_file_read<uint32_t>(p + 20);
+    uint32_t height = std::max(1u, texture_file_read<uint32_t>(p + 24));
+    uint32_t array_layers = texture_file_read<uint32_t>(p + 32);
+    uint32_t faces = texture_file_read<uint32_t>(p + 36);
+    uint32_t levels = std::max(1u, texture_file_read<uint32_t>(p + 40));
+    uint32_t supercompression = texture_file_read<uint32_t>(p + 44);
+    // supercompressed data (BasisLZ, zstd, ...) would need a CPU pass first
+    if (!texture.format || supercompression != 0 || texture_file_read<uint32_t>(p + 28) > 1) return false;
+    if (!texture_file_shape_valid(width, height, levels, array_layers, faces)) return false;
+    texture.width = (int) width;
+    texture.height = (int) height;
+    texture.layers = (int) array_layers;
+    texture.faces = (int) faces;
+    texture.levels = (int) levels;
+    if (size < 80 + (size_t) texture.levels * 24) return false;
+
+    int layers = std::max(1, texture.layers);
+    for (int level = 0; level < texture.levels; level++) {
+        const unsigned char *entry = p + 80 + level * 24;
+        uint64_t offset64 = texture_file_read<uint64_t>(entry), length = texture_file_read<uint64_t>(entry + 8);
+        if (offset64 > size || length > size - offset64) return false;
+        auto offset = (size_t) offset64;
+        size_t bytes = texture_file_level_size(texture.format, texture.width, texture.height, level), needed;
+        if (!texture_file_multiply(bytes, (size_t) layers * texture.faces, needed) || length < needed) return false;
+        for (int layer = 0; layer < layers; layer++) {
+            for (int face = 0; face < texture.faces; face++) {
+                texture.images.push_back({level, layer, face, p + offset, bytes});
+                offset += bytes;
+            }
+        }
+    }
+    return true;
+}
+
+inline bool load_texture_file(const char *path, TextureFile &texture) {
+    if (!texture.file.open(path)) return false;
+    texture.images.clear();
+    texture.layers = 0;
+    texture.faces = 1;
+    return load_ktx2(texture) || load_dds(texture);
+}
+
+inline GLenum texture_file_target(const TextureFile &texture) {
+    if (texture.faces == 6) return texture.layers > 0 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+    return texture.layers > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+}
+
+// immutable storage for the whole texture in name, which must not have storage yet, then one compressed sub image
+// upload per level / layer / face
+inline void upload_texture_file(GLuint name, const TextureFile &texture) {
+    GLenum target = texture_file_target(texture);
+    glBindTexture(target, name);
+    if (target == GL_TEXTURE_2D || target == GL_TEXTURE_CUBE_MAP)
+        glTexStorage2D(target, texture.levels, texture.format, texture.width, texture.height);
+    else
+        glTexStorage3D(target, texture.levels, texture.format, texture.width, texture.height,
+                       texture.layers * texture.faces);
+
+    for (const TextureFileImage &image: texture.images) {
+        int width = std::max(1, texture.width >> image.level), height = std::max(1, texture.height >> image.level);
+        switch (target) {
+            case GL_TEXTURE_2D:
+                glCompressedTexSubImage2D(target, image.level, 0, 0, width, height, texture.format,
+                                          (GLsizei) image.size, image.data);
+                break;
+            case GL_TEXTURE_CUBE_MAP:
+                glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + image.face, image.level, 0, 0, width,
+                                          height, texture.format, (GLsizei) image.size, image.data);
+                break;
+            default:
+                glCompressedTexSubImage3D(target, image.level, 0, 0, image.layer * texture.faces + image.face,
+                                          width, height, 1, texture.format, (GLsizei) image.size, image.data);
+                break;
+        }
+    }
+
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, texture.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+inline GLuint create_texture_from_file(const TextureFile &texture) {
+    GLuint name;
+    glGenTextures(1, &name);
+    upload_texture_file(name, texture);
+    return name;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "gl_state.h"
+#include "vecmath.h"
+
+/**
+ * Per-frame std140 uniform data in one ring buffer.
+ *
+ * Constants are written once per frame into this frame's region of the ring and bound to fixed binding points with
+ * glBindBufferRange, so every program that declares the block shares them without per-program glUniform* calls.
+ * The ring has one region per frame in flight, a region is fenced at end_frame() and only rewritten once the GPU is
+ * done with it. With GL_ARB_buffer_storage the buffer stays persistently mapped, otherwise pushes go through
+ * glBufferSubData.
+ * */
+
+// binding points shared by all programs, see bind_uniform_blocks
+enum UniformBinding : GLuint {
+    CameraBinding = 0,
+    ObjectBinding = 1,
+};
+
+// std140 layouts, keep in sync with the GLSL blocks
+struct CameraBlock {
+    mat4 viewProjection;
+};
+
+struct ObjectBlock {
+    mat4 model;
+};
+
+// GLSL ES 3.00 has no layout(binding = ...), assign the shared binding points after linking
+inline void bind_uniform_blocks(GLuint program) {
+    GLuint camera = glGetUniformBlockIndex(program, "Camera");
+    if (camera != GL_INVALID_INDEX) glUniformBlockBinding(program, camera, CameraBinding);
+    GLuint object = glGetUniformBlockIndex(program, "Object");
+    if (object != GL_INVALID_INDEX) glUniformBlockBinding(program, object, ObjectBinding);
+}
+
+class UniformRing {
+public:
+    explicit UniformRing(size_t frame_bytes = 64 * 1024, int frames = 3) : frames(frames) {
+        GLint align = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        alignment = (size_t) std::max(align, 1);
+        region = (frame_bytes + alignment - 1) / alignment * alignment;
+        fences.resize(frames, nullptr);
+
+        glGenBuffers(1, &buffer);
+        gl_state.bind_buffer(GL_UNIFORM_BUFFER, buffer);
+        if (GLEW_ARB_buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, (GLsizeiptr) (region * frames), nullptr, flags);
+            mapping = (unsigned char *) glMapBufferRange(GL_UNIFORM_BUFFER, 0, (GLsizeiptr) (region * frames), flags);
+        } else {
+            glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr) (region * frames), nullptr, GL_DYNAMIC_DRAW);
+        }
+    }
+
+    UniformRing(const UniformRing &) = delete;
+
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    ~UniformRing() {
+        release();
+    }
+
+    // free the GL objects while the context is still current, the destructor is a no-op afterwards
+    void release() {
+        for (auto &fence: fences) {
+            if (fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (buffer) {
+            if (mapping) {
+                gl_state.bind_buffer(GL_UNIFORM_BUFFER, buffer);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+            }
+            glDeleteBuffers(1, &buffer);
+            gl_state.forget_buffer(buffer);
+        }
+        buffer = 0;
+        mapping = nullptr;
+    }
+
+    // move to the next region, waits only if the GPU is still reading it from frames - 1 frames ago. false when
+    // waiting failed, the region may then still be read and nothing is pushed into it this frame
+    bool begin_frame() {
+        frame = (frame + 1) % frames;
+        head = 0;
+        GLsync &fence = fences[frame];
+        if (!fence) return true;
+        GLenum status;
+        do status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+        while (status == GL_TIMEOUT_EXPIRED);
+        if (status == GL_WAIT_FAILED) {
+            std::cout << "Waiting for a uniform ring fence failed" << std::endl;
+            head = region;
+            return false;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+        return true;
+    }
+
+    // copy bytes into this frame's region, returns the buffer offset to bind; -1 when the region is full
+    GLintptr push(const void *data, size_t bytes) {
+        if (head + bytes > region) return -1;
+        auto offset = (GLintptr) (frame * region + head);
+        if (mapping) {
+            std::memcpy(mapping + offset, data, bytes);
+        } else {
+            gl_state.bind_buffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, offset, (GLsizeiptr) bytes, data);
+        }
+        head += (bytes + alignment - 1) / alignment * alignment;
+        return offset;
+    }
+
+    template<typename T>
+    GLintptr push(const T &block) {
+        return push(&block, sizeof(T));
+    }
+
+    void bind(GLuint binding, GLintptr offset, size_t bytes) const {
+        gl_state.bind_buffer_range(GL_UNIFORM_BUFFER, binding, buffer, offset, (GLsizeiptr) bytes);
+    }
+
+    // push and bind in one go, false (binding left as it was) when the region is full
+    template<typename T>
+    [[nodiscard]] bool set(GLuint binding, const T &block) {
+        GLintptr offset = push(block);
+        if (offset < 0) return false;
+        bind(binding, offset, sizeof(T));
+        return true;
+    }
+
+    // fence this frame's region, call after the last draw that reads it
+    void end_frame() {
+        // still there when begin_frame could not wait for it, the new fence covers the same reads
+        if (fences[frame]) glDeleteSync(fences[frame]);
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    int frames;
+    int frame = 0;
+    size_t alignment = 256;
+    size_t region = 0;
+    size_t head = 0;
+    GLuint buffer = 0;
+    unsigned char *mapping = nullptr;
+    std::vector<GLsync> fences;
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bc.h"
+#include "mipmap.h"
+#include "spsc_queue.h"
+#include "texture.h"
+#include "texture_array.h"
+#include "texture_file.h"
+
+enum class MipSource {
+    Auto, // worker threads when there is a core to spare next to the upload thread, the GPU otherwise
+    Cpu,
+    Gpu,  // compute shader, glGenerateMipmap without one; compressed textures always filter on the CPU
+};
+
+// a 2D .ktx2 or .dds next to path (same name, other extension), loaded with its own mip chain
+inline bool load_precompressed(GLuint target, const char *path) {
+    for (const char *extension: {".ktx2", ".dds"}) {
+        std::string candidate = std::filesystem::path(path).replace_extension(extension).string();
+        std::error_code ec;
+        if (!std::filesystem::exists(candidate, ec)) continue;
+        TextureFile file;
+        if (!load_texture_file(candidate.c_str(), file) || texture_file_target(file) != GL_TEXTURE_2D) {
+            std::cout << "Ignoring " << candidate << ", not a 2D texture this loader understands" << std::endl;
+            continue;
+        }
+        upload_texture_file(target, file);
+        return true;
+    }
+    return false;
+}
+
+// load path into target, each mip level is uploaded as soon as the worker thread has filtered it.
+// A precompressed file next to the image is used instead when there is one (see load_precompressed).
+// Compressed chains are cached whole next to the image, a cache hit skips decoding, filtering and compression.
+// compute is used for MipSource::Gpu and may be null
+inline bool load_texture(GLuint target, const char *path, bool compress, bool bc7 = false,
+                         MipSource mips = MipSource::Auto, MipCompute *compute = nullptr) {
+    if (load_precompressed(target, path)) return true;
+
+    std::string cache = bc_cache_path(path, BcQuality::High, bc7);
+    std::vector<CompressedImage> compressed;
+    if (compress && load_compressed_cache(cache, path, compressed)) {
+        for (int level = 0; level < (int) compressed.size(); level++)
+            upload_compressed(target, compressed[level], level);
+        set_mip_filtering(target, (int) compressed.size() - 1);
+        return true;
+    }
+
+    Image image = load_image(path);
+    if (!image.data) return false;
+
+    if (mips == MipSource::Auto) mips = std::thread::hardware_concurrency() > 1 ? MipSource::Cpu : MipSource::Gpu;
+    if (!compress && mips == MipSource::Gpu) {
+        if (!compute || !compute->generate(target, image)) {
+            upload_image(target, image);
+            generate_mipmaps_driver(target);
+        }
+        stbi_image_free(image.data);
+        return true;
+    }
+
+    auto levels = generate_mip_chain_async(image);
+    if (compress) {
+        compressed.push_back(compress_image(image, BcQuality::High, bc7));
+        upload_compressed(target, compressed.back());
+    } else {
+        upload_image(target, image);
+    }
+    for (int level = 1; level <= (int) levels.size(); level++) {
+        const MipLevel &mip = levels[level - 1].get();
+        if (compress) {
+            compressed.push_back(compress_image(mip.image(), BcQuality::High, bc7));
+            upload_compressed(target, compressed.back(), level);
+        } else {
+            upload_image(target, mip.image(), level);
+        }
+    }
+    if (compress) save_compressed_cache(cache, compressed);
+    set_mip_filtering(target, (int) levels.size());
+    stbi_image_free(image.data);
+    return true;
+}
+
+// load path into layer of the GL_TEXTURE_2D_ARRAY array (a TextureArray) with its CPU mip chain, false when the image
+// does not have the array's size. A block compressed array gets every level compressed (High quality, the image
+// expanded to RGBA first) and the chain cached next to the image like load_texture does, an RGBA8 one the texels
+inline bool load_texture_layer(GLuint array, int layer, const char *path) {
+    GLint width = 0, height = 0, format = 0;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    bool compress = format != GL_RGBA8;
+    bool bc7 = format == GL_COMPRESSED_RGBA_BPTC_UNORM;
+
+    std::string cache = bc_cache_path(std::string(path) + ".rgba", BcQuality::High, bc7);
+    std::vector<CompressedImage> compressed;
+    if (compress && load_compressed_cache(cache, path, compressed) && compressed[0].format == (GLenum) format &&
+        compressed[0].width == width && compressed[0].height == height) {
+        for (int level = 0; level < (int) compressed.size(); level++)
+            upload_compressed_layer(layer, compressed[level], level);
+        return true;
+    }
+    compressed.clear();
+
+    Image image = load_image(path);
+    if (!image.data) return false;
+    bool fits = image.width == width && image.height == height;
+    if (fits && compress) {
+        std::vector<unsigned char> rgba = expand_to_rgba(image);
+        Image level{rgba.data(), width, height, 4};
+        std::vector<MipLevel> mips;
+        mips.reserve((size_t) mip_level_count(width, height));
+        while (true) {
+            compressed.push_back(compress_image(level, BcQuality::High, bc7));
+            upload_compressed_layer(layer, compressed.back(), (int) compressed.size() - 1);
+            if (level.width == 1 && level.height == 1) break;
+            mips.push_back(mip_halve(level));
+            level = mips.back().image();
+        }
+        save_compressed_cache(cache, compressed);
+    } else if (fits) {
+        auto levels = generate_mip_chain_async(image);
+        upload_array_layer(layer, image);
+        for (int level = 1; level <= (int) levels.size(); level++)
+            upload_array_layer(layer, levels[level - 1].get().image(), level);
+    } else {
+        std::cout << path << " is " << image.width << "x" << image.height << ", its texture array layers are "
+                  << width << "x" << height << std::endl;
+    }
+    stbi_image_free(image.data);
+    return fits;
+}
+
+struct UploadRequest {
+    int id = 0;
+    std::string path;
+    bool compress = false;
+    bool bc7 = false; // BC7 instead of BC1 / BC3 for 3 and 4 channel images
+    MipSource mips = MipSource::Auto;
+    GLuint array = 0; // load into this layer of a TextureArray instead of a texture of its own
+    int layer = 0;
+};
+
+struct UploadResult {
+    int id = 0;
+    GLuint texture = 0; // 0 when loading failed
+    bool array = false; // texture is the request's array and the image is in layer, the array stays the caller's
+    int layer = 0;
+    GLsync fence = nullptr;
+};
+
+/**
+ * Texture loading on a worker thread.
+ *
+ * The worker owns a hidden GLFW window whose context shares objects with the main window. Requests go in and
+ * finished textures come back through lock-free queues; each texture is fenced on the worker, and poll() on the
+ * render thread only hands it over once that fence has signalled, so it never waits for a load.
+ * */
+class UploadThread {
+public:
+    // has to be constructed on the main thread, GLFW windows can only be created there
+    explicit UploadThread(GLFWwindow *share) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        context = glfwCreateWindow(1, 1, "OpenGLPlayground upload", nullptr, share);
+        glfwDefaultWindowHints();
+        if (!context) return;
+        running = true;
+        worker = std::thread([this] { run(); });
+    }
+
+    UploadThread(const UploadThread &) = delete;
+
+    UploadThread &operator=(const UploadThread &) = delete;
+
+    ~UploadThread() {
+        stop();
+    }
+
+    bool available() const {
+        return context != nullptr;
+    }
+
+    // false when too many requests are queued, try again next frame
+    bool submit(UploadRequest request) {
+        return requests.push(std::move(request));
+    }
+
+    // call ready(const UploadResult &) for every texture that can be bound now, never blocks
+    template<typename F>
+    void poll(F ready) {
+        UploadResult result;
+        while (results.pop(result)) pending.push_back(result);
+        for (size_t i = 0; i < pending.size(); i++) {
+            UploadResult &candidate = pending[i];
+            if (candidate.fence) {
+                GLenum status = glClientWaitSync(candidate.fence, 0, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+                glDeleteSync(candidate.fence);
+            }
+            ready((const UploadResult &) candidate);
+            pending.erase(pending.begin() + (long) i--);
+        }
+    }
+
+    // join the worker and destroy its context, main thread only, before glfwTerminate. Textures that were never
+    // handed out by poll() are deleted
+    void stop() {
+        if (!context) return;
+        running = false;
+        worker.join();
+        UploadResult result;
+        while (results.pop(result)) pending.push_back(result);
+        for (auto &unclaimed: pending) {
+            if (unclaimed.fence) glDeleteSync(unclaimed.fence);
+            if (unclaimed.texture && !unclaimed.array) glDeleteTextures(1, &unclaimed.texture);
+        }
+        pending.clear();
+        glfwDestroyWindow(context);
+        context = nullptr;
+    }
+
+private:
+    GLFWwindow *context = nullptr;
+    std::thread worker;
+    std::atomic<bool> running{false};
+    SpscQueue<UploadRequest, 64> requests;
+    SpscQueue<UploadResult, 64> results;
+    std::vector<UploadResult> pending; // render thread only
+
+    void run() {
+        glfwMakeContextCurrent(context);
+        MipCompute compute;
+        MipCompute *gpuMips = MipCompute::supported() ? &compute : nullptr;
+        UploadRequest request;
+        while (running) {
+            if (!requests.pop(request)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            UploadResult result;
+            result.id = request.id;
+            if (request.array) {
+                if (load_texture_layer(request.array, request.layer, request.path.c_str())) {
+                    result.texture = request.array;
+                    result.layer = request.layer;
+                    result.array = true;
+                }
+            } else {
+                glGenTextures(1, &result.texture);
+                if (!load_texture(result.texture, request.path.c_str(), request.compress, request.bc7, request.mips,
+                                  gpuMips)) {
+                    glDeleteTextures(1, &result.texture);
+                    result.texture = 0;
+                }
+            }
+            if (result.texture) result.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            // make sure the commands (and the fence) reach the GPU, nothing else flushes this context
+            glFlush();
+            while (!results.push(std::move(result)) && running) std::this_thread::yield();
+        }
+        compute.release();
+        glfwMakeContextCurrent(nullptr);
+    }
+};
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VECMATH_SSE 1
+#endif
+
+/**
+ * Small CPU math library: vec3, vec4, column-major mat4 (same memory layout as glUniformMatrix4fv / std140 mat4)
+ * and unit quaternions. mat4 products and batched vec4 transforms use SSE when available and fall back to scalar
+ * code otherwise. perspective() and look_at() produce the same matrices as gluPerspective / gluLookAt.
+ * */
+
+struct vec3 {
+    float x, y, z;
+};
+
+struct alignas(16) vec4 {
+    float x, y, z, w;
+};
+
+// m[column * 4 + row]
+struct alignas(16) mat4 {
+    float m[16];
+
+    static mat4 identity() {
+        return {{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}};
+    }
+
+    const float *data() const {
+        return m;
+    }
+};
+
+struct quat {
+    float x, y, z, w;
+
+    static quat identity() {
+        return {0, 0, 0, 1};
+    }
+};
+
+inline vec3 operator+(vec3 a, vec3 b) {
+    return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+
+inline vec3 operator-(vec3 a, vec3 b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+inline vec3 operator*(vec3 a, float s) {
+    return {a.x * s, a.y * s, a.z * s};
+}
+
+inline float dot(vec3 a, vec3 b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline vec3 cross(vec3 a, vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+inline float length(vec3 a) {
+    return std::sqrt(dot(a, a));
+}
+
+inline vec3 normalize(vec3 a) {
+    float l = length(a);
+    return l > 0 ? a * (1 / l) : a;
+}
+
+inline mat4 operator*(const mat4 &a, const mat4 &b) {
+    mat4 r;
+#ifdef VECMATH_SSE
+    __m128 a0 = _mm_load_ps(a.m), a1 = _mm_load_ps(a.m + 4), a2 = _mm_load_ps(a.m + 8), a3 = _mm_load_ps(a.m + 12);
+    for (int c = 0; c < 4; c++) {
+        __m128 column = _mm_mul_ps(a0, _mm_set1_ps(b.m[c * 4]));
+        column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b.m[c * 4 + 1])));
+        column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b.m[c * 4 + 2])));
+        column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b.m[c * 4 + 3])));
+        _mm_store_ps(r.m + c * 4, column);
+    }
+#else
+    for (int c = 0; c < 4; c++) {
+        for (int row = 0; row < 4; row++) {
+            r.m[c * 4 + row] = a.m[row] * b.m[c * 4] + a.m[4 + row] * b.m[c * 4 + 1] +
+                               a.m[8 + row] * b.m[c * 4 + 2] + a.m[12 + row] * b.m[c * 4 + 3];
+        }
+    }
+#endif
+    return r;
+}
+
+inline vec4 operator*(const mat4 &a, const vec4 &v) {
+    vec4 r;
+#ifdef VECMATH_SSE
+    __m128 column = _mm_mul_ps(_mm_load_ps(a.m), _mm_set1_ps(v.x));
+    column = _mm_add_ps(column, _mm_mul_ps(_mm_load_ps(a.m + 4), _mm_set1_ps(v.y)));
+    column = _mm_add_ps(column, _mm_mul_ps(_mm_load_ps(a.m + 8), _mm_set1_ps(v.z)));
+    column = _mm_add_ps(column, _mm_mul_ps(_mm_load_ps(a.m + 12), _mm_set1_ps(v.w)));
+    _mm_store_ps(&r.x, column);
+#else
+    float *out = &r.x;
+    for (int row = 0; row < 4; row++)
+        out[row] = a.m[row] * v.x + a.m[4 + row] * v.y + a.m[8 + row] * v.z + a.m[12 + row] * v.w;
+#endif
+    return r;
+}
+
+// out[i] = m * in[i], in and out may be the same array
+inline void transform(const mat4 &m, const vec4 *in, vec4 *out, size_t count) {
+#ifdef VECMATH_SSE
+    __m128 c0 = _mm_load_ps(m.m), c1 = _mm_load_ps(m.m + 4), c2 = _mm_load_ps(m.m + 8), c3 = _mm_load_ps(m.m + 12);
+    for (size_t i = 0; i < count; i++) {
+        __m128 v = _mm_load_ps(&in[i].x);
+        __m128 r = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+        r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm_store_ps(&out[i].x, r);
+    }
+#else
+    for (size_t i = 0; i < count; i++) out[i] = m * in[i];
+#endif
+}
+
+// out[i] = a * b[i]
+inline void multiply(const mat4 &a, const mat4 *b, mat4 *out, size_t count) {
+    for (size_t i = 0; i < count; i++) out[i] = a * b[i];
+}
+
+inline mat4 transpose(const mat4 &a) {
+    mat4 r;
+    for (int c = 0; c < 4; c++) for (int row = 0; row < 4; row++) r.m[row * 4 + c] = a.m[c * 4 + row];
+    return r;
+}
+
+// general inverse by cofactors, identity if a is singular
+inline mat4 inverse(const mat4 &a) {
+    const float *m = a.m;
+    mat4 r;
+    float *inv = r.m;
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] +
+             m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] -
+             m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] +
+             m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] -
+              m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] -
+             m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] +
+             m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] -
+             m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] +
+              m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] +
+             m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] -
+             m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] +
+              m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] -
+              m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] -
+             m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] +
+             m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] -
+              m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] +
+              m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (det == 0) return mat4::identity();
+    det = 1 / det;
+    for (float &v: r.m) v *= det;
+    return r;
+}
+
+inline mat4 translate(vec3 t) {
+    mat4 r = mat4::identity();
+    r.m[12] = t.x;
+    r.m[13] = t.y;
+    r.m[14] = t.z;
+    return r;
+}
+
+inline mat4 scale(vec3 s) {
+    mat4 r = mat4::identity();
+    r.m[0] = s.x;
+    r.m[5] = s.y;
+    r.m[10] = s.z;
+    return r;
+}
+
+// gluPerspective, fovy in degrees
+inline mat4 perspective(float fovy, float aspect, float zNear, float zFar) {
+    float f = 1 / std::tan(fovy * (float) M_PI / 360);
+    mat4 r = {};
+    r.m[0] = f / aspect;
+    r.m[5] = f;
+    r.m[10] = (zFar + zNear) / (zNear - zFar);
+    r.m[11] = -1;
+    r.m[14] = 2 * zFar * zNear / (zNear - zFar);
+    return r;
+}
+
+// gluLookAt
+inline mat4 look_at(vec3 eye, vec3 center, vec3 up) {
+    vec3 f = normalize(center - eye);
+    vec3 s = normalize(cross(f, up));
+    vec3 u = cross(s, f);
+    mat4 r = mat4::identity();
+    r.m[0] = s.x;
+    r.m[4] = s.y;
+    r.m[8] = s.z;
+    r.m[1] = u.x;
+    r.m[5] = u.y;
+    r.m[9] = u.z;
+    r.m[2] = -f.x;
+    r.m[6] = -f.y;
+    r.m[10] = -f.z;
+    r.m[12] = -dot(s, eye);
+    r.m[13] = -dot(u, eye);
+    r.m[14] = dot(f, eye);
+    return r;
+}
+
+// angle in radians around a (not necessarily normalized) axis
+inline quat angle_axis(float angle, vec3 axis) {
+    vec3 a = normalize(axis) * std::sin(angle / 2);
+    return {a.x, a.y, a.z, std::cos(angle / 2)};
+}
+
+inline quat operator*(quat a, quat b) {
+    return {a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z};
+}
+
+inline quat normalize(quat q) {
+    float l = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    return l > 0 ? quat{q.x / l, q.y / l, q.z / l, q.w / l} : quat::identity();
+}
+
+inline vec3 rotate(quat q, vec3 v) {
+    vec3 u = {q.x, q.y, q.z};
+    vec3 t = cross(u, v) * 2;
+    return v + t * q.w + cross(u, t);
+}
+
+inline quat slerp(quat a, quat b, float t) {
+    float cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    // take the short way round
+    if (cosine < 0) {
+        b = {-b.x, -b.y, -b.z, -b.w};
+        cosine = -cosine;
+    }
+    float wa = 1 - t, wb = t;
+    if (cosine < 0.9995f) {
+        float angle = std::acos(cosine), sine = std::sin(angle);
+        wa = std::sin((1 - t) * angle) / sine;
+        wb = std::sin(t * angle) / sine;
+    }
+    return normalize(quat{wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z, wa * a.w + wb * b.w});
+}
+
+inline mat4 to_mat4(quat q) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    return {{1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0,
+             2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0,
+             2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0,
+             0, 0, 0, 1}};
+}
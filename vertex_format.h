@@ -0,0 +1,209 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+/**
+ * Interleaved, quantized vertex formats.
+ *
+ * A VertexFormat lists attributes with their storage type, offsets are packed in declaration order with every
+ * attribute 4 byte aligned. interleave() converts float source arrays into one buffer of that format and
+ * pack_indices() picks 16 bit indices whenever the vertex count allows it. Normalized types read back in the shader
+ * as floats, so shaders need no changes: snorm covers [-1, 1] (fold a larger position range into the model matrix),
+ * unorm [0, 1] and half floats anything else.
+ * */
+
+enum class VertexType {
+    Float,   // 4 bytes
+    Half,    // 2 bytes
+    Snorm16, // 2 bytes, [-1, 1]
+    Unorm16, // 2 bytes, [0, 1]
+    Snorm8,  // 1 byte, [-1, 1]
+    Unorm8,  // 1 byte, [0, 1]
+};
+
+inline size_t vertex_type_size(VertexType type) {
+    switch (type) {
+        case VertexType::Float:
+            return 4;
+        case VertexType::Half:
+        case VertexType::Snorm16:
+        case VertexType::Unorm16:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+inline GLenum vertex_type_gl(VertexType type) {
+    switch (type) {
+        case VertexType::Float:
+            return GL_FLOAT;
+        case VertexType::Half:
+            return GL_HALF_FLOAT;
+        case VertexType::Snorm16:
+            return GL_SHORT;
+        case VertexType::Unorm16:
+            return GL_UNSIGNED_SHORT;
+        case VertexType::Snorm8:
+            return GL_BYTE;
+        default:
+            return GL_UNSIGNED_BYTE;
+    }
+}
+
+// IEEE half with round to nearest even, overflow goes to infinity
+inline uint16_t float_to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    uint32_t sign = bits >> 16 & 0x8000;
+    int exponent = (int) (bits >> 23 & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if ((bits & 0x7fffffff) > 0x7f800000) return (uint16_t) (sign | 0x7e00); // NaN
+    if (exponent >= 31) return (uint16_t) (sign | 0x7c00);
+    if (exponent <= 0) {
+        if (exponent < -10) return (uint16_t) sign;
+        // denormal
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t) (14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1))) half++;
+        return (uint16_t) (sign | half);
+    }
+    uint32_t half = sign | (uint32_t) exponent << 10 | mantissa >> 13;
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return (uint16_t) half;
+}
+
+struct VertexAttribute {
+    GLuint location;
+    int components;
+    VertexType type;
+    size_t offset;
+};
+
+struct VertexFormat {
+    std::vector<VertexAttribute> attributes;
+    size_t stride = 0;
+
+    VertexFormat &add(GLuint location, int components, VertexType type) {
+        attributes.push_back({location, components, type, stride});
+        stride += (components * vertex_type_size(type) + 3) / 4 * 4;
+        return *this;
+    }
+
+    // set up every attribute for the buffer bound to GL_ARRAY_BUFFER (and the VAO bound now)
+    void apply(size_t base = 0) const {
+        for (const auto &attribute: attributes) {
+            bool normalized = attribute.type != VertexType::Float && attribute.type != VertexType::Half;
+            glVertexAttribPointer(attribute.location, attribute.components, vertex_type_gl(attribute.type),
+                                  normalized ? GL_TRUE : GL_FALSE, (GLsizei) stride,
+                                  (void *) (base + attribute.offset));
+            glEnableVertexAttribArray(attribute.location);
+        }
+    }
+};
+
+// float components in memory: a tightly packed float array, or a member of an array of structs given by the
+// struct's base pointer, its byte stride and the member's offsetof. Components the source does not have are filled
+// with 0, and 1 for w
+struct VertexSource {
+    const void *data;
+    int components;
+    size_t stride = 0; // bytes from one vertex to the next, 0 for components floats
+    size_t offset = 0; // bytes from data to the first component
+};
+
+inline void quantize_component(float value, VertexType type, unsigned char *out) {
+    switch (type) {
+        case VertexType::Float:
+            std::memcpy(out, &value, 4);
+            break;
+        case VertexType::Half: {
+            uint16_t half = float_to_half(value);
+            std::memcpy(out, &half, 2);
+            break;
+        }
+        case VertexType::Snorm16: {
+            auto v = (int16_t) std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+            std::memcpy(out, &v, 2);
+            break;
+        }
+        case VertexType::Unorm16: {
+            auto v = (uint16_t) std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f);
+            std::memcpy(out, &v, 2);
+            break;
+        }
+        case VertexType::Snorm8:
+            *(int8_t *) out = (int8_t) std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f);
+            break;
+        case VertexType::Unorm8:
+            *out = (unsigned char) std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+            break;
+    }
+}
+
+// one source per attribute of format, in the same order
+inline std::vector<unsigned char> interleave(const VertexFormat &format, size_t count,
+                                             std::initializer_list<VertexSource> sources) {
+    std::vector<unsigned char> out(format.stride * count, 0);
+    size_t a = 0;
+    for (const VertexSource &source: sources) {
+        const VertexAttribute &attribute = format.attributes[a++];
+        size_t stride = source.stride ? source.stride : source.components * sizeof(float);
+        size_t size = vertex_type_size(attribute.type);
+        for (size_t v = 0; v < count; v++) {
+            unsigned char *dst = &out[v * format.stride + attribute.offset];
+            const auto *src = (const unsigned char *) source.data + v * stride + source.offset;
+            for (int c = 0; c < attribute.components; c++) {
+                float value = c == 3 ? 1.0f : 0.0f;
+                if (c < source.components) std::memcpy(&value, src + c * sizeof(float), sizeof(float));
+                quantize_component(value, attribute.type, dst + c * size);
+            }
+        }
+    }
+    return out;
+}
+
+struct IndexData {
+    GLenum type = GL_UNSIGNED_SHORT;
+    size_t count = 0;
+    std::vector<unsigned char> bytes;
+};
+
+// 16 bit indices when every index fits (0xffff stays free for primitive restart), 32 bit otherwise
+template<typename T>
+IndexData pack_indices(const T *indices, size_t count) {
+    IndexData data;
+    data.count = count;
+    T largest = count ? *std::max_element(indices, indices + count) : 0;
+    if ((uint64_t) largest < 0xffff) {
+        data.type = GL_UNSIGNED_SHORT;
+        data.bytes.resize(count * 2);
+        for (size_t i = 0; i < count; i++) {
+            auto index = (uint16_t) indices[i];
+            std::memcpy(&data.bytes[i * 2], &index, 2);
+        }
+    } else {
+        data.type = GL_UNSIGNED_INT;
+        data.bytes.resize(count * 4);
+        for (size_t i = 0; i < count; i++) {
+            auto index = (uint32_t) indices[i];
+            std::memcpy(&data.bytes[i * 4], &index, 4);
+        }
+    }
+    return data;
+}
+
+inline size_t index_size(GLenum type) {
+    return type == GL_UNSIGNED_SHORT ? 2 : type == GL_UNSIGNED_BYTE ? 1 : 4;
+}